@@ -0,0 +1,237 @@
+/*******************************************************************************
+
+ LockFreeBuffer
+
+ Notes: Single-producer/single-consumer ring buffer, safe to share between
+ exactly one writing thread and one reading thread without locks. Like
+ CircularBuffer, this class is defined entirely in this header file.
+
+ The read and write indices run freely and are masked into the element
+ array, so the capacity is always rounded up to a power of two. Each index
+ lives on its own cache line, and is published with release semantics and
+ observed with acquire semantics, so an element is always fully written
+ before the other thread can see it.
+
+ The producer can also stage() several elements and then commit() them
+ with a single index update, so the consumer sees either all of them or
+ none. put() must not be mixed into a staged group.
+
+ ******************************************************************************/
+
+
+#ifndef __LOCK_FREE_BUFFER_H__
+#define __LOCK_FREE_BUFFER_H__
+
+
+#include <sys/types.h>
+#include <stddef.h>
+
+
+#define LOCK_FREE_BUFFER_CACHE_LINE 64
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+
+static inline size_t lfb_load_acquire(const size_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void lfb_store_release(size_t *p, size_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+#else
+
+// older gcc (e.g. the Raspbian/Angstrom toolchains) only has full barriers
+static inline size_t lfb_load_acquire(const size_t *p)
+{
+    size_t v = *(const volatile size_t *)p;
+    __sync_synchronize();
+    return v;
+}
+
+static inline void lfb_store_release(size_t *p, size_t v)
+{
+    __sync_synchronize();
+    *(volatile size_t *)p = v;
+}
+
+#endif
+
+
+template<typename T>
+class LockFreeBuffer
+{
+public:
+
+    LockFreeBuffer(size_t numElements) :
+    m_write(0),
+    m_readCache(0),
+    m_numStaged(0),
+    m_read(0),
+    m_writeCache(0)
+    {
+        // round up to a power of two, stopping at the largest one
+        const size_t TOP = ~(~(size_t)0 >> 1);
+        m_numElements = 1;
+        while(m_numElements < numElements && m_numElements < TOP)
+            m_numElements <<= 1;
+        m_mask = m_numElements-1;
+
+        m_elements = new T[m_numElements];
+    }
+
+    ~LockFreeBuffer()
+    {
+        if(m_elements != NULL)
+        {
+            delete[] m_elements;
+            m_elements = NULL;
+        }
+    }
+
+    // put one element (producer thread only)
+    // returns number of elements successfully put
+    size_t put(const T &element)
+    {
+        if(m_write - m_readCache == m_numElements)
+        {
+            m_readCache = lfb_load_acquire(&m_read);
+            if(m_write - m_readCache == m_numElements)
+            {
+                // no space
+                return 0;
+            }
+        }
+
+        m_elements[m_write & m_mask] = element;
+
+        lfb_store_release(&m_write, m_write+1);
+
+        return 1;
+    }
+
+    // write one element after those already staged, without publishing it
+    // (producer thread only)
+    // returns number of elements successfully staged
+    size_t stage(const T &element)
+    {
+        size_t write = m_write + m_numStaged;
+        if(write - m_readCache == m_numElements)
+        {
+            m_readCache = lfb_load_acquire(&m_read);
+            if(write - m_readCache == m_numElements)
+            {
+                // no space
+                return 0;
+            }
+        }
+
+        m_elements[write & m_mask] = element;
+        m_numStaged++;
+
+        return 1;
+    }
+
+    // publish every staged element at once (producer thread only)
+    void commit()
+    {
+        if(m_numStaged)
+            lfb_store_release(&m_write, m_write+m_numStaged);
+        m_numStaged = 0;
+    }
+
+    // forget the staged elements (producer thread only)
+    void discard() { m_numStaged = 0; }
+
+    // number of elements staged and not yet committed
+    size_t numStaged() { return m_numStaged; }
+
+    // get one element (consumer thread only)
+    // returns number of elements successfully got
+    size_t get(T &element)
+    {
+        if(m_read == m_writeCache)
+        {
+            m_writeCache = lfb_load_acquire(&m_write);
+            if(m_read == m_writeCache)
+            {
+                // nothing to get
+                return 0;
+            }
+        }
+
+        element = m_elements[m_read & m_mask];
+
+        lfb_store_release(&m_read, m_read+1);
+
+        return 1;
+    }
+
+    // get up to maxElements elements at once (consumer thread only)
+    // the read index is only published once, after all elements are copied
+    // returns number of elements successfully got
+    size_t get(T *elements, size_t maxElements)
+    {
+        m_writeCache = lfb_load_acquire(&m_write);
+
+        size_t n = m_writeCache - m_read;
+        if(n > maxElements)
+            n = maxElements;
+
+        for(size_t i = 0; i < n; i++)
+            elements[i] = m_elements[(m_read+i) & m_mask];
+
+        if(n)
+            lfb_store_release(&m_read, m_read+n);
+
+        return n;
+    }
+
+    // return maximum number of elements that can be held
+    size_t maxElements() { return m_numElements; }
+
+    // return if buffer is full
+    // (only exact from the producer thread)
+    bool atMaximum()
+    {
+        return m_write - lfb_load_acquire(&m_read) == m_numElements;
+    }
+
+    // return number of valid elements in the buffer
+    // (a snapshot; may be stale by the time it is used)
+    size_t numElements()
+    {
+        return lfb_load_acquire(&m_write) - lfb_load_acquire(&m_read);
+    }
+
+private:
+
+    // copying would alias the element array
+    LockFreeBuffer(const LockFreeBuffer &);
+    LockFreeBuffer &operator=(const LockFreeBuffer &);
+
+    // shared, read-only after construction
+    T * m_elements;
+    size_t m_numElements;
+    size_t m_mask;
+
+    char m_pad0[LOCK_FREE_BUFFER_CACHE_LINE];
+
+    // producer side
+    size_t m_write;
+    size_t m_readCache;
+    size_t m_numStaged;
+
+    char m_pad1[LOCK_FREE_BUFFER_CACHE_LINE - 3*sizeof(size_t)];
+
+    // consumer side
+    size_t m_read;
+    size_t m_writeCache;
+
+    char m_pad2[LOCK_FREE_BUFFER_CACHE_LINE - 2*sizeof(size_t)];
+};
+
+
+#endif // __LOCK_FREE_BUFFER_H__
@@ -0,0 +1,155 @@
+/*******************************************************************************
+
+ SGCoalescer
+
+ Notes: Last-writer-wins folding of the property updates the render thread
+ has collected for one frame. A POSITION, SIZE, COLOR, RED, GREEN, BLUE or
+ ALPHA message is folded away when every property it sets is set again by a
+ later message to the same object in the same frame, so each object gets at
+ most one effective update per property per frame.
+
+ Creating an object is a barrier: updates before it are never folded into
+ updates after it. Streamed pixels are treated like one more property:
+ a SUBIMAGE message is folded when a later one to the same object replaces
+ the whole image (a full /sg/pixels frame), so only the newest of several
+ frames received in one frame time is uploaded. Removing an object makes every earlier update to it
+ irrelevant, so those are folded too.
+
+ Messages addressed by pattern are left alone, and don't fold anything
+ either: which objects they reach is only known once they are handled.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_COALESCER_H__
+#define __SG_COALESCER_H__
+
+
+#include <vector>
+#include "SGMessage.h"
+
+
+class SGCoalescer
+{
+public:
+
+    SGCoalescer() : m_numFolded(0) { }
+
+    // mark the messages in msgs[0..numMsgs) that are superseded by later
+    // messages; skip is resized to numMsgs
+    // returns number of messages folded away
+    size_t coalesce(const SGMessage *msgs, size_t numMsgs, std::vector<bool> &skip)
+    {
+        skip.assign(numMsgs, false);
+
+        size_t numFolded = 0;
+
+        // walk backwards, remembering which properties of each object are
+        // already set by a later message
+        for(size_t i = numMsgs; i > 0; i--)
+        {
+            const SGMessage &msg = msgs[i-1];
+            if(msg.isPattern())
+                continue;
+
+            unsigned &written = writtenFor(msg.handle);
+
+            if(msg.type == SGMessage::SUBIMAGE)
+            {
+                if(written & PROP_PIXELS)
+                {
+                    skip[i-1] = true;
+                    numFolded++;
+                }
+                else if(msg.replacesFrame())
+                    written |= PROP_PIXELS;
+                continue;
+            }
+
+            if(!msg.isPropertyUpdate())
+            {
+                written = (msg.type == SGMessage::REMOVE) ? PROP_ALL : 0;
+                continue;
+            }
+
+            unsigned props = properties(msg.type);
+            if((props & ~written) == 0)
+            {
+                skip[i-1] = true;
+                numFolded++;
+            }
+            else
+                written |= props;
+        }
+
+        // reset only the entries this frame touched
+        for(size_t t = 0; t < m_touched.size(); t++)
+            m_written[m_touched[t]] = UNTOUCHED;
+        m_touched.clear();
+
+        m_numFolded += numFolded;
+        return numFolded;
+    }
+
+    // total messages folded away since construction
+    size_t numFolded() const { return m_numFolded; }
+
+    enum Property
+    {
+        PROP_POSITION = 1 << 0,
+        PROP_SIZE = 1 << 1,
+        PROP_RED = 1 << 2,
+        PROP_GREEN = 1 << 3,
+        PROP_BLUE = 1 << 4,
+        PROP_ALPHA = 1 << 5,
+        // every pixel of an image
+        PROP_PIXELS = 1 << 6,
+
+        PROP_COLOR = PROP_RED | PROP_GREEN | PROP_BLUE | PROP_ALPHA,
+        PROP_ALL = PROP_POSITION | PROP_SIZE | PROP_COLOR | PROP_PIXELS,
+    };
+
+    // properties set by a property update message
+    static unsigned properties(SGMessage::Type type)
+    {
+        switch(type)
+        {
+            case SGMessage::POSITION: return PROP_POSITION;
+            case SGMessage::SIZE: return PROP_SIZE;
+            case SGMessage::COLOR: return PROP_COLOR;
+            case SGMessage::RED: return PROP_RED;
+            case SGMessage::GREEN: return PROP_GREEN;
+            case SGMessage::BLUE: return PROP_BLUE;
+            case SGMessage::ALPHA: return PROP_ALPHA;
+            default: return 0;
+        }
+    }
+
+private:
+
+    enum { UNTOUCHED = ~0U };
+
+    // the written-properties mask of an object handle, cleared to 0 the
+    // first time it is used in a frame
+    unsigned &writtenFor(unsigned handle)
+    {
+        if(handle >= m_written.size())
+            m_written.resize(handle+1, UNTOUCHED);
+
+        if(m_written[handle] == UNTOUCHED)
+        {
+            m_written[handle] = 0;
+            m_touched.push_back(handle);
+        }
+
+        return m_written[handle];
+    }
+
+    // indexed by object handle
+    std::vector<unsigned> m_written;
+    std::vector<unsigned> m_touched;
+    size_t m_numFolded;
+};
+
+
+#endif // __SG_COALESCER_H__
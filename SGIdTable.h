@@ -0,0 +1,172 @@
+/*******************************************************************************
+
+ SGIdTable
+
+ Notes: Interns object id strings into small integer handles, so everything
+ downstream of the OSC thread can index arrays instead of comparing strings.
+ Handles are dense (0, 1, 2, ...) and a given id always gets the same handle.
+ Handles are never recycled, even after the object is removed, since an id
+ that was used once is likely to be used again.
+
+ The lookup is a flat open-addressing hash table (linear probing, power-of-
+ two size, kept at most half full) holding the handle and the full hash of
+ each id, so a probe only compares strings when the hashes already match.
+
+ The names are copied into a pool of fixed-size chunks that is only ever
+ appended to, so a name never moves once interned: name() pointers can be
+ handed to other threads along with the handle (with the usual release/
+ acquire publication, e.g. through a LockFreeBuffer) and stay valid for the
+ life of the table. Interning an id that is already known allocates
+ nothing; a new one allocates only when its chunk fills up.
+
+ Not thread-safe; only the OSC thread interns ids.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_ID_TABLE_H__
+#define __SG_ID_TABLE_H__
+
+
+#include <vector>
+#include <string.h>
+
+
+// 32-bit FNV-1a of the len bytes at str, the hash every SG table uses
+static inline unsigned sgHash(const char *str, size_t len)
+{
+    unsigned hash = 2166136261U;
+    for(size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+class SGIdTable
+{
+public:
+
+    // bytes of names per pool chunk (longer names get a chunk of their own)
+    static const size_t CHUNK_SIZE = 16384;
+
+    SGIdTable(size_t initialSlots = 1024) : m_chunkNext(NULL), m_chunkFree(0)
+    {
+        size_t numSlots = 1;
+        while(numSlots < initialSlots)
+            numSlots <<= 1;
+        m_slots.assign(numSlots, Slot());
+        m_names.reserve(numSlots/2);
+    }
+
+    ~SGIdTable()
+    {
+        for(size_t c = 0; c < m_chunks.size(); c++)
+            delete[] m_chunks[c];
+    }
+
+    // return the handle for id, assigning the next free one if id is new
+    unsigned intern(const char *id)
+    {
+        size_t len = strlen(id);
+        unsigned hash = sgHash(id, len);
+        size_t mask = m_slots.size()-1;
+
+        for(size_t i = hash & mask; ; i = (i+1) & mask)
+        {
+            Slot &slot = m_slots[i];
+            if(slot.handle == EMPTY)
+            {
+                unsigned handle = m_names.size();
+                m_names.push_back(store(id, len));
+                slot.handle = handle;
+                slot.hash = hash;
+                slot.length = len;
+
+                if(m_names.size()*2 > m_slots.size())
+                    grow();
+
+                return handle;
+            }
+
+            if(slot.hash == hash && slot.length == len &&
+               memcmp(m_names[slot.handle], id, len) == 0)
+                return slot.handle;
+        }
+    }
+
+    // the id string of a handle returned by intern(); the pointer stays
+    // valid, and may be used on any thread, until the table is destroyed
+    const char *name(unsigned handle) const { return m_names[handle]; }
+
+    // number of distinct ids interned so far
+    size_t size() const { return m_names.size(); }
+
+private:
+
+    enum { EMPTY = ~0U };
+
+    // copying would free the pool twice
+    SGIdTable(const SGIdTable &);
+    SGIdTable &operator=(const SGIdTable &);
+
+    struct Slot
+    {
+        Slot() : handle(EMPTY), hash(0), length(0) { }
+        unsigned handle;
+        unsigned hash;
+        size_t length;
+    };
+
+    // copy a name (and its terminator) into the pool
+    const char *store(const char *str, size_t len)
+    {
+        if(len+1 > m_chunkFree)
+        {
+            size_t chunkSize = len+1 > CHUNK_SIZE ? len+1 : CHUNK_SIZE;
+            m_chunks.push_back(new char[chunkSize]);
+            m_chunkNext = m_chunks.back();
+            m_chunkFree = chunkSize;
+        }
+
+        char *name = m_chunkNext;
+        memcpy(name, str, len);
+        name[len] = '\0';
+        m_chunkNext += len+1;
+        m_chunkFree -= len+1;
+        return name;
+    }
+
+    // double the slot array and reinsert every handle
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        m_slots.assign(old.size()*2, Slot());
+        size_t mask = m_slots.size()-1;
+
+        for(size_t s = 0; s < old.size(); s++)
+        {
+            if(old[s].handle == EMPTY)
+                continue;
+
+            size_t i = old[s].hash & mask;
+            while(m_slots[i].handle != EMPTY)
+                i = (i+1) & mask;
+            m_slots[i] = old[s];
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    // indexed by handle, pointing into m_chunks
+    std::vector<const char *> m_names;
+    std::vector<char *> m_chunks;
+    // free space in the last chunk
+    char *m_chunkNext;
+    size_t m_chunkFree;
+};
+
+
+#endif // __SG_ID_TABLE_H__
@@ -0,0 +1,230 @@
+/*******************************************************************************
+
+ SGImageLoader
+
+ Notes: Decodes image files on a pool of worker threads, so loading a large
+ PNG or JPEG never stalls the render thread. load() queues a file, tagged
+ with a pointer of the caller's choosing; poll() hands back each decoded
+ STImage (or NULL if the file couldn't be loaded) with its tag, in the order
+ decoding finished. The loader never dereferences a tag.
+
+ Compressed files (ETC1 .pkm) can be handed back as an STCompressedImage
+ instead, for GLs that take them as they are; otherwise they are decoded
+ like any other image.
+
+ load() and poll() may only be called from one thread (the GL thread). If
+ start() was never called, load() decodes synchronously.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_IMAGE_LOADER_H__
+#define __SG_IMAGE_LOADER_H__
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "STImage.h"
+#include "STCompressedImage.h"
+
+
+class SGImageLoader
+{
+public:
+
+    struct Result
+    {
+        void *tag;
+        // at most one of these is set; both are NULL if the image could not
+        // be loaded
+        STImage *image;
+        STCompressedImage *compressed;
+    };
+
+    SGImageLoader() : m_stopping(false), m_numPending(0)
+    {
+        pthread_mutex_init(&m_requestMutex, NULL);
+        pthread_cond_init(&m_requestCond, NULL);
+        pthread_mutex_init(&m_resultMutex, NULL);
+    }
+
+    ~SGImageLoader()
+    {
+        stop();
+
+        for(size_t i = 0; i < m_results.size(); i++)
+        {
+            delete m_results[i].image;
+            delete m_results[i].compressed;
+        }
+
+        pthread_mutex_destroy(&m_requestMutex);
+        pthread_cond_destroy(&m_requestCond);
+        pthread_mutex_destroy(&m_resultMutex);
+    }
+
+    // start numThreads decoding threads
+    void start(int numThreads)
+    {
+        for(int t = 0; t < numThreads; t++)
+        {
+            pthread_t thread;
+            if(pthread_create(&thread, NULL, workerMain, this) == 0)
+                m_threads.push_back(thread);
+        }
+    }
+
+    // finish the decode in progress on each thread, then stop them all
+    void stop()
+    {
+        pthread_mutex_lock(&m_requestMutex);
+        m_stopping = true;
+        pthread_cond_broadcast(&m_requestCond);
+        pthread_mutex_unlock(&m_requestMutex);
+
+        for(size_t t = 0; t < m_threads.size(); t++)
+            pthread_join(m_threads[t], NULL);
+        m_threads.clear();
+    }
+
+    // queue the image file at path for decoding, at no less than
+    // targetWidth x targetHeight if the format allows decoding it smaller
+    // (see STImage); with keepCompressed set, a compressed file is loaded
+    // without decoding it
+    void load(const std::string &path, int targetWidth, int targetHeight,
+              bool keepCompressed, void *tag)
+    {
+        m_numPending++;
+
+        Request request = { path, targetWidth, targetHeight, keepCompressed, tag };
+
+        if(m_threads.empty())
+        {
+            finish(decode(request));
+            return;
+        }
+
+        pthread_mutex_lock(&m_requestMutex);
+        m_requests.push_back(request);
+        pthread_cond_signal(&m_requestCond);
+        pthread_mutex_unlock(&m_requestMutex);
+    }
+
+    // take the oldest finished decode, if any; the caller owns result.image
+    // and result.compressed
+    // returns false if nothing has finished
+    bool poll(Result &result)
+    {
+        pthread_mutex_lock(&m_resultMutex);
+        bool got = !m_results.empty();
+        if(got)
+        {
+            result = m_results.front();
+            m_results.pop_front();
+        }
+        pthread_mutex_unlock(&m_resultMutex);
+
+        if(got)
+            m_numPending--;
+
+        return got;
+    }
+
+    // number of images queued or decoded but not yet polled
+    size_t numPending() const { return m_numPending; }
+
+private:
+
+    struct Request
+    {
+        std::string path;
+        int targetWidth, targetHeight;
+        bool keepCompressed;
+        void *tag;
+    };
+
+    static void *workerMain(void *loader)
+    {
+        ((SGImageLoader *) loader)->work();
+        return NULL;
+    }
+
+    void work()
+    {
+        while(true)
+        {
+            pthread_mutex_lock(&m_requestMutex);
+            while(m_requests.empty() && !m_stopping)
+                pthread_cond_wait(&m_requestCond, &m_requestMutex);
+            if(m_stopping)
+            {
+                pthread_mutex_unlock(&m_requestMutex);
+                return;
+            }
+            Request request = m_requests.front();
+            m_requests.pop_front();
+            pthread_mutex_unlock(&m_requestMutex);
+
+            finish(decode(request));
+        }
+    }
+
+    // the result has no image (after printing the reason) if the file can't
+    // be loaded
+    static Result decode(const Request &request)
+    {
+        const std::string &path = request.path;
+        Result result = { request.tag, NULL, NULL };
+
+        try
+        {
+            if(request.keepCompressed && STCompressedImage::IsCompressedFile(path))
+                result.compressed = new STCompressedImage(path);
+            else
+                result.image = new STImage(path, request.targetWidth,
+                    request.targetHeight);
+        }
+        catch(std::runtime_error &e)
+        {
+            fprintf(stderr, "SimpleGraphics: can't load image '%s': %s\n",
+                path.c_str(), e.what());
+        }
+        catch(std::runtime_error *e)
+        {
+            fprintf(stderr, "SimpleGraphics: can't load image '%s': %s\n",
+                path.c_str(), e->what());
+            delete e;
+        }
+
+        return result;
+    }
+
+    void finish(const Result &result)
+    {
+        pthread_mutex_lock(&m_resultMutex);
+        m_results.push_back(result);
+        pthread_mutex_unlock(&m_resultMutex);
+    }
+
+    std::vector<pthread_t> m_threads;
+
+    pthread_mutex_t m_requestMutex;
+    pthread_cond_t m_requestCond;
+    // guarded by m_requestMutex
+    std::deque<Request> m_requests;
+    bool m_stopping;
+
+    pthread_mutex_t m_resultMutex;
+    // guarded by m_resultMutex
+    std::deque<Result> m_results;
+
+    // only touched by the calling thread
+    size_t m_numPending;
+};
+
+
+#endif // __SG_IMAGE_LOADER_H__
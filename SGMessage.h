@@ -0,0 +1,117 @@
+/*******************************************************************************
+
+ SGMessage
+
+ Notes: One decoded /sg/ OSC command, as handed from the OSC thread to the
+ render thread.
+
+ A message is a fixed-size, trivially copyable record, so the queue moves it
+ with a plain copy and decoding one allocates nothing. Strings aren't held
+ in it: objectId and str point at names interned by the OSC thread's
+ SGIdTables, which never move or free them, so they stay valid on the
+ render thread for as long as the program runs. Arguments are packed into
+ plain floats rather than STPoint2/STColor4f, whose copies aren't trivial.
+
+ A property update or /sg/remove may address objects by an OSC pattern
+ (see SGPattern) instead of a single id. Such a message has the handle
+ PATTERN_HANDLE and the pattern as its objectId, and applies to every
+ object whose id matches the pattern when it is handled.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_MESSAGE_H__
+#define __SG_MESSAGE_H__
+
+
+#include <stddef.h>
+
+
+struct SGMessage
+{
+    enum Type
+    {
+        LINE,
+        TRIANGLE,
+        RECT,
+        ELLIPSE,
+        IMAGE,
+        TEXT,
+        // replace a rectangle of an image's pixels
+        SUBIMAGE,
+        REMOVE,
+
+        POSITION,
+        SIZE,
+        COLOR,
+        RED,
+        GREEN,
+        BLUE,
+        ALPHA,
+    };
+
+    struct Point
+    {
+        float x, y;
+    };
+
+    struct Color
+    {
+        float r, g, b, a;
+    };
+
+    // handle of a message whose objectId is a pattern
+    enum { PATTERN_HANDLE = ~0U };
+
+    Type type;
+    // interned by the OSC thread's SGIdTable
+    const char *objectId;
+    unsigned handle;
+
+    Point position;
+    Point size;
+    Color color;
+    // /sg/image only: the image file, interned like objectId
+    const char *str;
+    // SUBIMAGE only: the RGBA pixels of the rectangle at position, size
+    // pixels large, are at this position of SGImage::pixelRing
+    size_t pixels;
+    // SUBIMAGE only: the size of the whole image the rectangle is a tile
+    // of (/sg/pixels), or 0 to keep the image's size (/sg/subimage)
+    int frameWidth, frameHeight;
+    // /sg/image only: 1 to mipmap the image, 0 not to, -1 for the default
+    int mipmaps;
+    // the OSC time tag of the bundle the message came in, when it is to be
+    // applied (see SGScheduler); 1 for "immediately", as for messages sent
+    // outside of bundles
+    unsigned long long timeTag;
+    // true for the messages of an OSC bundle of more than one message,
+    // which reach the render thread all at once (see SGMessageQueue)
+    bool bundled;
+    // true for the last message of its bundle
+    bool endsBundle;
+
+    // true for messages that only change a property of an existing object
+    // (as opposed to creating or removing one)
+    bool isPropertyUpdate() const { return type >= POSITION; }
+
+    // true for messages addressing every object matching a pattern
+    bool isPattern() const { return handle == PATTERN_HANDLE; }
+
+    // SUBIMAGE only: the pixel ring position just past the pixels
+    size_t pixelsEnd() const
+    {
+        return pixels + (size_t) size.x * (size_t) size.y * 4;
+    }
+
+    // true for a SUBIMAGE message that replaces every pixel of its image
+    bool replacesFrame() const
+    {
+        return type == SUBIMAGE && frameWidth > 0 &&
+            position.x == 0 && position.y == 0 &&
+            size.x == frameWidth && size.y == frameHeight;
+    }
+};
+
+
+#endif // __SG_MESSAGE_H__
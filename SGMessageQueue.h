@@ -0,0 +1,384 @@
+/*******************************************************************************
+
+ SGMessageQueue
+
+ Notes: Ingest queue between the OSC thread and the render thread. Messages
+ go through a LockFreeBuffer of fixed capacity. When that is full, the OSC
+ thread keeps them in a private overflow list, which is handled according to
+ the queue's OverflowPolicy and moved into the buffer as space frees up
+ (on the next put(), or from the periodic TimerExpired() callback).
+
+ Only property updates (position, size, color...) are ever dropped or
+ coalesced. Messages that create or remove objects always wait in the
+ overflow list, so a burst can delay them but never lose them.
+
+ The messages put() between begin() and commit() (those of one OSC bundle)
+ are a transaction: getTransactions() returns all of them at once, or none,
+ so the render thread never shows a frame with only part of a bundle
+ applied. They are staged in the LockFreeBuffer and published with one
+ index update, or wait in the overflow list together, where the policy
+ leaves them alone. A bundle larger than the whole buffer can only be
+ published in pieces; getTransactions() keeps the pieces it has back until
+ the last one arrives. abort() drops a transaction instead of committing it.
+
+ put(), begin(), commit(), abort(), flush() and TimerExpired() may only be
+ called from the OSC thread, get() and getTransactions() only from the
+ render thread. The counters may be read from anywhere.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_MESSAGE_QUEUE_H__
+#define __SG_MESSAGE_QUEUE_H__
+
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include "LockFreeBuffer.h"
+#include "SGPixelRing.h"
+#include "SGMessage.h"
+#include "SGCoalescer.h"
+#include "ip/TimerListener.h"
+
+
+class SGMessageQueue : public TimerListener
+{
+public:
+
+    enum OverflowPolicy
+    {
+        // keep every message, letting the overflow list grow without bound
+        GROW,
+        // when the overflow list is full, discard its oldest update
+        DROP_OLDEST,
+        // when the buffer is full, discard incoming updates
+        DROP_NEWEST,
+        // replace a waiting update of the same type to the same object;
+        // when the overflow list is still full, discard its oldest update
+        COALESCE,
+    };
+
+    SGMessageQueue(size_t capacity, OverflowPolicy policy) :
+    m_buffer(capacity),
+    m_capacity(m_buffer.maxElements()),
+    m_policy(policy),
+    m_numDropped(0),
+    m_numCoalesced(0),
+    m_numOverflowed(0),
+    m_inTransaction(false),
+    m_numBundledWaiting(0),
+    m_numPartial(0)
+    { }
+
+    // queue one message (OSC thread only)
+    void put(const SGMessage &msg)
+    {
+        if(m_inTransaction)
+        {
+            m_transaction.push_back(msg);
+            return;
+        }
+
+        flush();
+
+        // messages already waiting in the overflow list have to go first
+        if(m_overflow.empty() && m_buffer.put(msg))
+            return;
+
+        lfb_store_release(&m_numOverflowed, m_numOverflowed+1);
+
+        if(!msg.isPropertyUpdate())
+        {
+            m_overflow.push_back(msg);
+            return;
+        }
+
+        switch(m_policy)
+        {
+            case GROW:
+                m_overflow.push_back(msg);
+            break;
+
+            case DROP_NEWEST:
+                countDropped();
+            break;
+
+            case DROP_OLDEST:
+                m_overflow.push_back(msg);
+                if(overflowFull())
+                    dropOldest();
+            break;
+
+            case COALESCE:
+                if(coalesce(msg))
+                    break;
+                m_overflow.push_back(msg);
+                if(overflowFull())
+                    dropOldest();
+            break;
+        }
+    }
+
+    // hold the messages put from now on until commit() (OSC thread only)
+    void begin()
+    {
+        m_inTransaction = true;
+        m_transaction.clear();
+    }
+
+    // queue the messages put since begin() as one transaction
+    // (OSC thread only)
+    void commit()
+    {
+        m_inTransaction = false;
+        if(m_transaction.size() <= 1)
+        {
+            if(!m_transaction.empty())
+                put(m_transaction[0]);
+            return;
+        }
+
+        for(size_t i = 0; i < m_transaction.size(); i++)
+        {
+            m_transaction[i].bundled = true;
+            m_transaction[i].endsBundle = i+1 == m_transaction.size();
+        }
+
+        flush();
+
+        // nothing waiting: stage it straight into the buffer if it fits
+        if(m_overflow.empty())
+        {
+            size_t n = 0;
+            while(n < m_transaction.size() && m_buffer.stage(m_transaction[n]))
+                n++;
+            if(n == m_transaction.size())
+            {
+                m_buffer.commit();
+                return;
+            }
+            m_buffer.discard();
+        }
+
+        bool waiting = !m_overflow.empty();
+        m_overflow.insert(m_overflow.end(), m_transaction.begin(), m_transaction.end());
+        m_numBundledWaiting += m_transaction.size();
+        flush();
+        if(waiting || !m_overflow.empty())
+        {
+            lfb_store_release(&m_numOverflowed,
+                m_numOverflowed + m_transaction.size());
+        }
+    }
+
+    // discard the messages put since begin(), as for a bundle that turned
+    // out to be malformed, giving back the streamed pixels they reserved
+    // in pixelRing (OSC thread only)
+    void abort(SGPixelRing *pixelRing)
+    {
+        m_inTransaction = false;
+        for(size_t i = 0; i < m_transaction.size(); i++)
+        {
+            if(m_transaction[i].type == SGMessage::SUBIMAGE)
+            {
+                pixelRing->uncommit(m_transaction[i].pixels);
+                break;
+            }
+        }
+        m_transaction.clear();
+    }
+
+    // move as much of the overflow list into the buffer as fits, a whole
+    // transaction at a time (OSC thread only)
+    void flush()
+    {
+        while(!m_overflow.empty())
+        {
+            size_t n = 0;
+            bool complete = false;
+            while(n < m_overflow.size() && m_buffer.stage(m_overflow[n]))
+            {
+                const SGMessage &msg = m_overflow[n++];
+                if(!msg.bundled || msg.endsBundle)
+                {
+                    complete = true;
+                    break;
+                }
+            }
+
+            // wait for space, unless not even an empty buffer could hold it
+            if(!complete && m_buffer.numStaged() < m_buffer.maxElements())
+            {
+                m_buffer.discard();
+                return;
+            }
+
+            m_buffer.commit();
+            if(m_overflow.front().bundled)
+                m_numBundledWaiting -= n;
+            m_overflow.erase(m_overflow.begin(), m_overflow.begin() + n);
+        }
+    }
+
+    // periodic callback from the OSC thread's SocketReceiveMultiplexer, so
+    // the overflow list drains even if no more packets arrive
+    virtual void TimerExpired() { flush(); }
+
+    // get up to maxMessages messages (render thread only)
+    size_t get(SGMessage *msgs, size_t maxMessages)
+    {
+        return m_buffer.get(msgs, maxMessages);
+    }
+
+    // get every complete transaction published so far, holding back the
+    // first pieces of a bundle whose last piece hasn't been published yet
+    // (render thread only; don't mix with get())
+    // returns the number of messages got; msgs is grown to fit them
+    size_t getTransactions(std::vector<SGMessage> &msgs)
+    {
+        size_t numMsgs = m_numPartial, numGot;
+        if(msgs.size() < numMsgs)
+            msgs.resize(numMsgs);
+        std::copy(m_partial.begin(), m_partial.begin() + numMsgs, msgs.begin());
+
+        do
+        {
+            if(msgs.size() < numMsgs + GET_BATCH_SIZE)
+                msgs.resize(numMsgs + GET_BATCH_SIZE);
+            numGot = m_buffer.get(&msgs[numMsgs], GET_BATCH_SIZE);
+            numMsgs += numGot;
+        } while(numGot > 0);
+
+        size_t numComplete = numMsgs;
+        while(numComplete > 0 && msgs[numComplete-1].bundled &&
+            !msgs[numComplete-1].endsBundle)
+            numComplete--;
+
+        m_numPartial = numMsgs - numComplete;
+        if(m_partial.size() < m_numPartial)
+            m_partial.resize(m_numPartial);
+        std::copy(msgs.begin() + numComplete, msgs.begin() + numMsgs, m_partial.begin());
+
+        return numComplete;
+    }
+
+    size_t capacity() const { return m_capacity; }
+    OverflowPolicy policy() const { return m_policy; }
+
+    // total messages discarded by the overflow policy
+    size_t numDropped() const { return lfb_load_acquire(&m_numDropped); }
+    // total messages merged into an already-waiting message
+    size_t numCoalesced() const { return lfb_load_acquire(&m_numCoalesced); }
+    // total messages that found the buffer full
+    size_t numOverflowed() const { return lfb_load_acquire(&m_numOverflowed); }
+
+    // parse a policy name as given on the command line
+    // returns false if the name is not recognized
+    static bool policyFromString(const char *name, OverflowPolicy &policy)
+    {
+        if(strcmp(name, "grow") == 0)
+            policy = GROW;
+        else if(strcmp(name, "drop-oldest") == 0)
+            policy = DROP_OLDEST;
+        else if(strcmp(name, "drop-newest") == 0)
+            policy = DROP_NEWEST;
+        else if(strcmp(name, "coalesce") == 0)
+            policy = COALESCE;
+        else
+            return false;
+
+        return true;
+    }
+
+private:
+
+    void countDropped()
+    {
+        lfb_store_release(&m_numDropped, m_numDropped+1);
+    }
+
+    // whether the overflow list holds more messages than the queue's
+    // capacity, not counting transactions, which are never dropped
+    bool overflowFull() const
+    {
+        return m_overflow.size() - m_numBundledWaiting > m_capacity;
+    }
+
+    // discard the oldest waiting property update outside a transaction
+    void dropOldest()
+    {
+        for(std::deque<SGMessage>::iterator i = m_overflow.begin();
+            i != m_overflow.end(); i++)
+        {
+            if(i->isPropertyUpdate() && !i->bundled)
+            {
+                m_overflow.erase(i);
+                countDropped();
+                return;
+            }
+        }
+    }
+
+    // overwrite the most recent waiting update of the same type to the same
+    // object, unless that object was created or removed in between, a
+    // message addressed by pattern (which may have touched it) came between,
+    // an update setting some of the same properties (COLOR and RED, say)
+    // came between, the two are scheduled for different times, or the
+    // waiting one is part of a transaction
+    // returns true if msg was absorbed
+    bool coalesce(const SGMessage &msg)
+    {
+        if(msg.isPattern())
+            return false;
+
+        unsigned props = SGCoalescer::properties(msg.type);
+        for(std::deque<SGMessage>::reverse_iterator i = m_overflow.rbegin();
+            i != m_overflow.rend(); i++)
+        {
+            if(i->isPattern())
+                return false;
+            if(i->handle != msg.handle)
+                continue;
+            if(!i->isPropertyUpdate() || i->bundled || i->timeTag != msg.timeTag)
+                return false;
+            if(i->type == msg.type)
+            {
+                *i = msg;
+                lfb_store_release(&m_numCoalesced, m_numCoalesced+1);
+                return true;
+            }
+            if(SGCoalescer::properties(i->type) & props)
+                return false;
+        }
+
+        return false;
+    }
+
+    LockFreeBuffer<SGMessage> m_buffer;
+    // only touched by the OSC thread
+    std::deque<SGMessage> m_overflow;
+
+    const size_t m_capacity;
+    const OverflowPolicy m_policy;
+
+    size_t m_numDropped;
+    size_t m_numCoalesced;
+    size_t m_numOverflowed;
+
+    // messages put since begin(), while m_inTransaction
+    bool m_inTransaction;
+    std::vector<SGMessage> m_transaction;
+    // messages of transactions in m_overflow
+    size_t m_numBundledWaiting;
+
+    // most messages getTransactions() takes from the buffer at a time
+    enum { GET_BATCH_SIZE = 64 };
+    // only touched by the render thread: the pieces of a bundle so far
+    std::vector<SGMessage> m_partial;
+    size_t m_numPartial;
+};
+
+
+#endif // __SG_MESSAGE_QUEUE_H__
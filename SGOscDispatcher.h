@@ -0,0 +1,117 @@
+/*******************************************************************************
+
+ SGOscDispatcher
+
+ Notes: Maps OSC address patterns to handlers in one hash lookup, for packet
+ listeners with a fixed set of addresses. It does the job of oscpack's
+ MessageMappingOscPacketListener, without a std::map walk of strcmps and a
+ dynamic_cast for every message: the handler can be anything copyable,
+ typically a member function pointer of the listener plus whatever
+ arguments its decoder needs.
+
+ The addresses are hashed (with sgHash() from SGIdTable.h) into an
+ open-addressed table at least four times larger than the number of
+ addresses, so a lookup hashes the address once, almost always lands on its
+ slot first try, and confirms it with a single strcmp. Unknown addresses usually stop at an empty slot
+ without any string compare.
+
+ The table is filled once, before any lookups; the addresses are not
+ copied and have to outlive it (string literals, as a rule).
+
+ ******************************************************************************/
+
+
+#ifndef __SG_OSC_DISPATCHER_H__
+#define __SG_OSC_DISPATCHER_H__
+
+
+#include <string.h>
+#include <vector>
+#include "SGIdTable.h"
+
+
+template<typename Handler>
+class SGOscDispatcher
+{
+public:
+
+    SGOscDispatcher() : m_numEntries(0)
+    {
+        m_slots.resize(16);
+        m_mask = m_slots.size()-1;
+    }
+
+    // map address to handler
+    void add(const char *address, const Handler &handler)
+    {
+        if((m_numEntries+1) * 4 > m_slots.size())
+            grow();
+
+        Slot slot;
+        slot.address = address;
+        slot.hash = hash(address);
+        slot.handler = handler;
+        insert(slot);
+        m_numEntries++;
+    }
+
+    // the handler of address, or NULL if it has none
+    const Handler *find(const char *address) const
+    {
+        unsigned h = hash(address);
+        for(size_t s = h & m_mask; m_slots[s].address != NULL; s = (s+1) & m_mask)
+        {
+            if(m_slots[s].hash == h && strcmp(m_slots[s].address, address) == 0)
+                return &m_slots[s].handler;
+        }
+
+        return NULL;
+    }
+
+private:
+
+    struct Slot
+    {
+        Slot() : address(NULL), hash(0) { }
+
+        // NULL for an empty slot
+        const char *address;
+        unsigned hash;
+        Handler handler;
+    };
+
+    static unsigned hash(const char *address)
+    {
+        return sgHash(address, strlen(address));
+    }
+
+    void insert(const Slot &slot)
+    {
+        size_t s = slot.hash & m_mask;
+        while(m_slots[s].address != NULL)
+            s = (s+1) & m_mask;
+        m_slots[s] = slot;
+    }
+
+    // double the table, rehashing every slot
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        m_slots.resize(old.size() * 2);
+        m_mask = m_slots.size()-1;
+
+        for(size_t s = 0; s < old.size(); s++)
+        {
+            if(old[s].address != NULL)
+                insert(old[s]);
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    size_t m_numEntries;
+};
+
+
+#endif // __SG_OSC_DISPATCHER_H__
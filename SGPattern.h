@@ -0,0 +1,298 @@
+/*******************************************************************************
+
+ SGPattern
+
+ Notes: OSC 1.0 address pattern matching, applied to object ids so one
+ message can address a group of objects:
+
+   ?        any one character
+   *        any run of characters, including none
+   [abc]    any of the listed characters; a-z ranges and a leading !
+            (matching anything not listed) are allowed
+   {ab,cd}  any of the listed strings
+
+ Object ids are matched as whole strings; unlike in an OSC address, '/' is
+ not special.
+
+ Patterns come from the network and are tested against every object in
+ range, so matching never backtracks further than the last *: a pattern
+ without {..} groups takes at most (pattern length) x (id length) steps,
+ however many stars it has. Each combination of {..} alternatives is
+ matched that way in turn; patterns with more than MAX_EXPANSIONS
+ combinations match nothing.
+
+ prefixes() lists the literal strings every match has to start with, so a
+ caller with its ids in sorted order only has to test the ids in those
+ ranges. Leading {..} groups are expanded into one prefix per alternative;
+ the prefix ends at the first ?, * or [.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_PATTERN_H__
+#define __SG_PATTERN_H__
+
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+
+class SGPattern
+{
+public:
+
+    // most prefixes a pattern is expanded into; past this, {..} groups
+    // end the prefix instead of multiplying it
+    static const size_t MAX_PREFIXES = 64;
+
+    // whether str contains any pattern syntax at all
+    static bool isPattern(const char *str)
+    {
+        return strpbrk(str, "?*[]{}") != NULL;
+    }
+
+    // most brace-free patterns a pattern may expand into (the product of
+    // the number of alternatives of each {..} group); match() matches none
+    // of the ids against a pattern with more
+    static const size_t MAX_EXPANSIONS = 256;
+
+    // whether str matches pattern
+    static bool match(const char *pattern, const char *str)
+    {
+        size_t n = numExpansions(pattern);
+        if(n > MAX_EXPANSIONS)
+            return false;
+
+        for(size_t e = 0; e < n; e++)
+        {
+            if(matchExpansion(pattern, str, e))
+                return true;
+        }
+        return false;
+    }
+
+    // the number of brace-free patterns pattern expands into, counted up
+    // to just past MAX_EXPANSIONS
+    static size_t numExpansions(const char *pattern)
+    {
+        size_t n = 1;
+        for(const char *p = pattern; *p != '\0' && n <= MAX_EXPANSIONS; )
+        {
+            if(*p == '[')
+            {
+                p = skipClass(p);
+                continue;
+            }
+
+            const char *close = *p == '{' ? strchr(p, '}') : NULL;
+            if(close == NULL)
+            {
+                p++;
+                continue;
+            }
+
+            n *= numAlternatives(p, close);
+            p = close+1;
+        }
+        return n;
+    }
+
+    // the literal prefixes of pattern's matches, none of them a prefix of
+    // another, in sorted order; "" if matches may start with anything
+    static void prefixes(const char *pattern, std::vector<std::string> &out)
+    {
+        out.assign(1, std::string());
+
+        const char *p = pattern;
+        while(*p != '\0' && *p != '*' && *p != '?' && *p != '[')
+        {
+            if(*p != '{')
+            {
+                for(size_t i = 0; i < out.size(); i++)
+                    out[i] += *p;
+                p++;
+                continue;
+            }
+
+            const char *close = strchr(p, '}');
+            if(close == NULL)
+                break;
+
+            size_t numAlts = numAlternatives(p, close);
+            if(out.size() * numAlts > MAX_PREFIXES)
+                break;
+
+            std::vector<std::string> expanded;
+            for(const char *alt = p+1; alt <= close; )
+            {
+                const char *end = alt;
+                while(end < close && *end != ',')
+                    end++;
+                for(size_t i = 0; i < out.size(); i++)
+                    expanded.push_back(out[i] + std::string(alt, end));
+                alt = end+1;
+            }
+            out.swap(expanded);
+            p = close+1;
+        }
+
+        // drop prefixes already covered by a shorter one
+        std::sort(out.begin(), out.end());
+        size_t kept = 0;
+        for(size_t i = 0; i < out.size(); i++)
+        {
+            if(kept > 0 && out[i].compare(0, out[kept-1].size(), out[kept-1]) == 0)
+                continue;
+            out[kept++] = out[i];
+        }
+        out.resize(kept);
+    }
+
+private:
+
+    // whether str matches pattern with alternative
+    // (e / the alternatives of the earlier groups) % (its alternatives) of
+    // each {..} group. The pieces between stars are then of fixed length,
+    // so taking the earliest place each one fits is never worse than a
+    // later one, and a mismatch only has to go back to the last *.
+    static bool matchExpansion(const char *pattern, const char *str, size_t e)
+    {
+        const char *p = pattern, *s = str;
+        // the pattern just past the last *, and where in str it is tried
+        // against next
+        const char *star = NULL, *restart = NULL;
+        size_t starE = 0;
+
+        for(;;)
+        {
+            if(*p == '*')
+            {
+                while(*p == '*')
+                    p++;
+                if(*p == '\0')
+                    return true;
+                star = p;
+                restart = s;
+                starE = e;
+                continue;
+            }
+
+            if(*p == '\0' && *s == '\0')
+                return true;
+
+            const char *next = p+1;
+            size_t len = 1, nextE = e;
+            bool matched;
+            switch(*p)
+            {
+                case '\0':
+                    matched = false;
+                break;
+
+                case '?':
+                    matched = *s != '\0';
+                break;
+
+                case '[':
+                    matched = *s != '\0' && matchClass(p, *s);
+                    next = skipClass(p);
+                break;
+
+                case '{':
+                {
+                    const char *close = strchr(p, '}');
+                    if(close == NULL)
+                    {
+                        matched = false;
+                        break;
+                    }
+
+                    size_t numAlts = numAlternatives(p, close);
+                    size_t a = e % numAlts;
+                    nextE = e / numAlts;
+
+                    const char *alt = p+1;
+                    for(; a > 0; a--)
+                        alt = strchr(alt, ',') + 1;
+                    const char *end = alt;
+                    while(end < close && *end != ',')
+                        end++;
+
+                    len = end - alt;
+                    matched = strncmp(s, alt, len) == 0;
+                    next = close+1;
+                }
+                break;
+
+                default:
+                    matched = *p == *s;
+                break;
+            }
+
+            if(matched)
+            {
+                p = next;
+                s += len;
+                e = nextE;
+                continue;
+            }
+
+            // let the last * take one more character, if there is one
+            if(star == NULL || *restart == '\0')
+                return false;
+            restart++;
+            p = star;
+            s = restart;
+            e = starE;
+        }
+    }
+
+    // the number of comma separated alternatives of the {..} group from
+    // p to its } at close
+    static size_t numAlternatives(const char *p, const char *close)
+    {
+        size_t numAlts = 1;
+        for(const char *c = p; c < close; c++)
+            numAlts += *c == ',';
+        return numAlts;
+    }
+
+    // whether c is in the [..] class at p
+    static bool matchClass(const char *p, char c)
+    {
+        const char *end = skipClass(p) - 1;
+        p++;
+
+        bool negate = *p == '!';
+        if(negate)
+            p++;
+
+        bool found = false;
+        for(; p < end; p++)
+        {
+            if(p[1] == '-' && p+2 < end)
+            {
+                if(c >= p[0] && c <= p[2])
+                    found = true;
+                p += 2;
+            }
+            else if(*p == c)
+                found = true;
+        }
+
+        return found != negate;
+    }
+
+    // the end of the [..] class at p: just past its ], or the end of the
+    // pattern if it has none
+    static const char *skipClass(const char *p)
+    {
+        const char *close = strchr(p+1, ']');
+        return close != NULL ? close+1 : p + strlen(p);
+    }
+};
+
+
+#endif // __SG_PATTERN_H__
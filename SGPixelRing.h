@@ -0,0 +1,139 @@
+/*******************************************************************************
+
+ SGPixelRing
+
+ Notes: Single-producer/single-consumer ring of bytes carrying streamed
+ pixels from the OSC thread to the render thread. The OSC thread converts
+ each /sg/pixels (or /sg/subimage) blob straight from the received packet
+ into space reserved here, and passes the position of that space along in
+ the SGMessage; the render thread uploads the texture from it in place and
+ then releases it. Nothing is allocated or copied in between, however many
+ frames go through.
+
+ Every reservation is contiguous: one that doesn't fit before the end of
+ the ring starts over at the beginning, and the unused tail is given back
+ with it. Space is released in the order it was reserved, which is the
+ order of the messages.
+
+ The messages themselves go through a LockFreeBuffer, whose release/acquire
+ ordering also makes the pixels visible before the message that names
+ them. So only the read position is shared here.
+
+ reserve(), commit() and uncommit() may only be called from the OSC thread,
+ at() and release() only from the render thread.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_PIXEL_RING_H__
+#define __SG_PIXEL_RING_H__
+
+
+#include "LockFreeBuffer.h"
+
+
+class SGPixelRing
+{
+public:
+
+    SGPixelRing(size_t numBytes) :
+    m_write(0),
+    m_numDropped(0),
+    m_read(0)
+    {
+        // round up to a power of two, stopping at the largest one
+        const size_t TOP = ~(~(size_t)0 >> 1);
+        m_size = 1;
+        while(m_size < numBytes && m_size < TOP)
+            m_size <<= 1;
+        m_mask = m_size-1;
+
+        m_bytes = new unsigned char[m_size];
+    }
+
+    ~SGPixelRing()
+    {
+        delete[] m_bytes;
+    }
+
+    // find numBytes contiguous free bytes (producer thread only)
+    // returns them, and their position in start, or NULL if the render
+    // thread hasn't released enough yet
+    unsigned char *reserve(size_t numBytes, size_t &start)
+    {
+        start = m_write;
+        size_t offset = start & m_mask;
+        if(offset + numBytes > m_size)
+            start += m_size - offset;
+
+        if(start + numBytes - lfb_load_acquire(&m_read) > m_size)
+            return NULL;
+
+        return m_bytes + (start & m_mask);
+    }
+
+    // take numBytes reserved at start (producer thread only)
+    void commit(size_t start, size_t numBytes)
+    {
+        m_write = start + numBytes;
+    }
+
+    // give back everything committed from start on, for messages that
+    // were never published after all (producer thread only)
+    void uncommit(size_t start)
+    {
+        m_write = start;
+    }
+
+    // the bytes at a position from reserve() (consumer thread only)
+    const unsigned char *at(size_t start) const
+    {
+        return m_bytes + (start & m_mask);
+    }
+
+    // give back everything up to end, a position just past committed
+    // bytes (consumer thread only)
+    void release(size_t end)
+    {
+        lfb_store_release(&m_read, end);
+    }
+
+    // capacity in bytes, which is also the largest possible reservation
+    size_t size() const { return m_size; }
+
+    // count a frame dropped because reserve() failed (producer thread only)
+    void countDropped()
+    {
+        lfb_store_release(&m_numDropped, m_numDropped+1);
+    }
+
+    // frames dropped so far
+    size_t numDropped() { return lfb_load_acquire(&m_numDropped); }
+
+private:
+
+    // copying would alias the bytes
+    SGPixelRing(const SGPixelRing &);
+    SGPixelRing &operator=(const SGPixelRing &);
+
+    // shared, read-only after construction
+    unsigned char *m_bytes;
+    size_t m_size;
+    size_t m_mask;
+
+    char m_pad0[LOCK_FREE_BUFFER_CACHE_LINE];
+
+    // producer side
+    size_t m_write;
+    size_t m_numDropped;
+
+    char m_pad1[LOCK_FREE_BUFFER_CACHE_LINE - 2*sizeof(size_t)];
+
+    // consumer side
+    size_t m_read;
+
+    char m_pad2[LOCK_FREE_BUFFER_CACHE_LINE - sizeof(size_t)];
+};
+
+
+#endif // __SG_PIXEL_RING_H__
@@ -0,0 +1,188 @@
+/*******************************************************************************
+
+ SGScheduler
+
+ Notes: Holds messages from timestamped OSC bundles on the render thread
+ until the frame they are due in, so network jitter between the sender and
+ us doesn't show up as jitter in the animation.
+
+ A message is due at its bundle's time tag plus a fixed latency. The
+ latency lets a sender that stamps bundles with the time it sends them
+ (rather than some time ahead) have them all arrive early, and shown a
+ constant delay later instead of whenever they happen to arrive. Times are
+ OSC time tags: 32.32 fixed point seconds since 1900, as NTP uses. The
+ sender's clock and ours are assumed to agree, NTP being what keeps them
+ that way.
+
+ Messages outside of bundles, or in bundles tagged "immediately", are never
+ held. A message that arrives after the frame it was due in is applied on
+ the next frame, and counted as late; one held for a later frame is counted
+ as early. Held messages wait in a binary min-heap on their due time, and
+ come out in that order; messages due at the same time come out in the
+ order they arrived. So a bundle is still applied all on one frame, except
+ for any bundle nested in it with a later time tag, which gets its own.
+
+ Everything here is only used from the render thread.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_SCHEDULER_H__
+#define __SG_SCHEDULER_H__
+
+
+#include <vector>
+#include <algorithm>
+#include <sys/time.h>
+#include "SGMessage.h"
+
+
+class SGScheduler
+{
+public:
+
+    typedef unsigned long long TimeTag;
+
+    // the time tag meaning "as soon as possible" (0 is taken the same way)
+    static const TimeTag IMMEDIATELY = 1;
+
+    SGScheduler() :
+    m_latency(0),
+    m_frame(0),
+    m_lastFrame(0),
+    m_numArrived(0),
+    m_numHeldPixels(0),
+    m_numEarly(0),
+    m_numLate(0)
+    { }
+
+    // add milliseconds to the due time of every timestamped message
+    void setLatency(unsigned milliseconds)
+    {
+        m_latency = ((TimeTag) milliseconds << 32) / 1000;
+    }
+
+    // the current time as an OSC time tag
+    static TimeTag now()
+    {
+        // seconds from 1900 (NTP's epoch) to 1970 (gettimeofday's)
+        const TimeTag EPOCH_OFFSET = 2208988800ULL;
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (((TimeTag) tv.tv_sec + EPOCH_OFFSET) << 32) +
+            ((TimeTag) tv.tv_usec << 32) / 1000000;
+    }
+
+    // take a message received since the last frame
+    // returns true if it should be applied on the current frame, false if
+    // it is held for a later one
+    bool arrive(const SGMessage &msg)
+    {
+        if(msg.timeTag <= IMMEDIATELY)
+            return true;
+
+        TimeTag due = msg.timeTag + m_latency;
+        if(due <= m_frame)
+        {
+            // due on an earlier frame than this one
+            if(due <= m_lastFrame)
+                m_numLate++;
+            return true;
+        }
+
+        Entry entry;
+        entry.due = due;
+        entry.order = m_numArrived++;
+        entry.msg = msg;
+        m_held.push_back(entry);
+        std::push_heap(m_held.begin(), m_held.end(), later);
+
+        if(msg.type == SGMessage::SUBIMAGE)
+            m_numHeldPixels++;
+        m_numEarly++;
+        return false;
+    }
+
+    // start the frame at frameTime, moving the held messages due by then
+    // into msgs, in order
+    // returns the number of messages moved; msgs is grown to fit them
+    size_t release(TimeTag frameTime, std::vector<SGMessage> &msgs)
+    {
+        m_lastFrame = m_frame;
+        m_frame = frameTime;
+
+        size_t numMsgs = 0;
+        while(!m_held.empty() && m_held.front().due <= frameTime)
+        {
+            std::pop_heap(m_held.begin(), m_held.end(), later);
+
+            const SGMessage &msg = m_held.back().msg;
+            if(msg.type == SGMessage::SUBIMAGE)
+                m_numHeldPixels--;
+            if(msgs.size() <= numMsgs)
+                msgs.resize(numMsgs+1);
+            msgs[numMsgs++] = msg;
+
+            m_held.pop_back();
+        }
+
+        return numMsgs;
+    }
+
+    // the earliest SGPixelRing position used by a held SUBIMAGE message,
+    // or end if there is none; the ring can't be released beyond it
+    size_t firstHeldPixels(size_t end) const
+    {
+        if(m_numHeldPixels == 0)
+            return end;
+
+        for(size_t i = 0; i < m_held.size(); i++)
+        {
+            const SGMessage &msg = m_held[i].msg;
+            if(msg.type == SGMessage::SUBIMAGE && msg.pixels < end)
+                end = msg.pixels;
+        }
+        return end;
+    }
+
+    // messages waiting for their frame
+    size_t size() const { return m_held.size(); }
+
+    // total messages held for a later frame
+    size_t numEarly() const { return m_numEarly; }
+    // total messages that arrived after the frame they were due in
+    size_t numLate() const { return m_numLate; }
+
+private:
+
+    struct Entry
+    {
+        TimeTag due;
+        // arrival order, to keep messages due together in order
+        size_t order;
+        SGMessage msg;
+    };
+
+    // heap order: the entry to release first ends up in front
+    static bool later(const Entry &a, const Entry &b)
+    {
+        if(a.due != b.due)
+            return a.due > b.due;
+        return a.order > b.order;
+    }
+
+    TimeTag m_latency;
+    // times of the current and the previous frame
+    TimeTag m_frame;
+    TimeTag m_lastFrame;
+    std::vector<Entry> m_held;
+    size_t m_numArrived;
+    size_t m_numHeldPixels;
+
+    size_t m_numEarly;
+    size_t m_numLate;
+};
+
+
+#endif // __SG_SCHEDULER_H__
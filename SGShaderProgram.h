@@ -0,0 +1,218 @@
+/*******************************************************************************
+
+ SGShaderProgram
+
+ Notes: The GLSL program every SimpleGraphics object draws with. All vertex
+ attributes are bound to fixed indices before linking, and all uniform
+ locations are looked up once after linking, so nothing on the render path
+ ever asks the driver for a location by name. Uniforms are set through the
+ Uniform enum, and a value identical to the one last set is not sent again.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_SHADER_PROGRAM_H__
+#define __SG_SHADER_PROGRAM_H__
+
+
+#include <GLES2/gl2.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+
+// Index to bind the attributes to vertex shaders
+#define VERTEX_ARRAY    0
+#define COLOR_ARRAY     1
+#define TEXCOORD_ARRAY  2
+#define SHAPE_ARRAY     3
+
+
+class SGShaderProgram
+{
+public:
+
+    enum Uniform
+    {
+        PMV_MATRIX,
+        COLOR,
+        TEX_OFFSET,
+        TEX,
+
+        NUM_UNIFORMS
+    };
+
+    SGShaderProgram() : m_program(0), m_vertShader(0), m_fragShader(0)
+    {
+        for(int u = 0; u < NUM_UNIFORMS; u++)
+        {
+            m_locations[u] = -1;
+            m_cached[u] = false;
+        }
+    }
+
+    // compile and link the program from the given shader source files, and
+    // resolve its locations
+    // returns false (after printing the reason) on failure
+    bool load(const char *vertFile, const char *fragFile)
+    {
+        m_fragShader = compile(GL_FRAGMENT_SHADER, fragFile);
+        if(m_fragShader == 0)
+            return false;
+        m_vertShader = compile(GL_VERTEX_SHADER, vertFile);
+        if(m_vertShader == 0)
+            return false;
+
+        // Create the shader program
+        m_program = glCreateProgram();
+
+        // Attach the fragment and vertex shaders to it
+        glAttachShader(m_program, m_fragShader);
+        glAttachShader(m_program, m_vertShader);
+
+        // Bind the custom vertex attributes to their fixed locations
+        glBindAttribLocation(m_program, VERTEX_ARRAY, "myVertex");
+        glBindAttribLocation(m_program, COLOR_ARRAY, "myColor");
+        glBindAttribLocation(m_program, TEXCOORD_ARRAY, "texCoordIn");
+        glBindAttribLocation(m_program, SHAPE_ARRAY, "myShape");
+
+        // Link the program
+        glLinkProgram(m_program);
+
+        // Check if linking succeeded
+        GLint bLinked;
+        glGetProgramiv(m_program, GL_LINK_STATUS, &bLinked);
+
+        if (!bLinked)
+        {
+            int ui32InfoLogLength, ui32CharsWritten;
+            glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &ui32InfoLogLength);
+            char* pszInfoLog = new char[ui32InfoLogLength];
+            glGetProgramInfoLog(m_program, ui32InfoLogLength, &ui32CharsWritten, pszInfoLog);
+            printf("Failed to link program: %s\n", pszInfoLog);
+            delete [] pszInfoLog;
+            return false;
+        }
+
+        static const char *names[NUM_UNIFORMS] =
+        {
+            "myPMVMatrix",
+            "color",
+            "texOffset",
+            "tex",
+        };
+
+        for(int u = 0; u < NUM_UNIFORMS; u++)
+        {
+            m_locations[u] = glGetUniformLocation(m_program, names[u]);
+            m_cached[u] = false;
+        }
+
+        return true;
+    }
+
+    // frees the GL program and shaders
+    void destroy()
+    {
+        glDeleteProgram(m_program);
+        glDeleteShader(m_fragShader);
+        glDeleteShader(m_vertShader);
+        m_program = m_fragShader = m_vertShader = 0;
+    }
+
+    void use() { glUseProgram(m_program); }
+
+    GLuint id() const { return m_program; }
+
+    GLint location(Uniform u) const { return m_locations[u]; }
+
+    void uniform4f(Uniform u, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+    {
+        GLfloat v[4] = { v0, v1, v2, v3 };
+        if(changed(u, v, 4))
+            glUniform4f(m_locations[u], v0, v1, v2, v3);
+    }
+
+    void uniform1i(Uniform u, GLint i)
+    {
+        GLfloat v = (GLfloat) i;
+        if(changed(u, &v, 1))
+            glUniform1i(m_locations[u], i);
+    }
+
+    void uniformMatrix4fv(Uniform u, const GLfloat *m)
+    {
+        if(changed(u, m, 16))
+            glUniformMatrix4fv(m_locations[u], 1, GL_FALSE, m);
+    }
+
+private:
+
+    // remember v as the value of u
+    // returns false if u already had exactly this value
+    bool changed(Uniform u, const GLfloat *v, int n)
+    {
+        if(m_cached[u] && memcmp(m_values[u], v, n*sizeof(GLfloat)) == 0)
+            return false;
+
+        memcpy(m_values[u], v, n*sizeof(GLfloat));
+        m_cached[u] = true;
+        return true;
+    }
+
+    // returns the shader handle, or 0 on failure
+    static GLuint compile(GLenum type, const char *filename)
+    {
+        std::ifstream in(filename);
+        if(!in)
+        {
+            printf("Failed to open shader file '%s'\n", filename);
+            return 0;
+        }
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string str = ss.str();
+        const char *source = str.c_str();
+
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        // Check if compilation succeeded
+        GLint bShaderCompiled;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &bShaderCompiled);
+
+        if (!bShaderCompiled)
+        {
+            // An error happened, first retrieve the length of the log message
+            int i32InfoLogLength, i32CharsWritten;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &i32InfoLogLength);
+
+            // Allocate enough space for the message and retrieve it
+            char* pszInfoLog = new char[i32InfoLogLength];
+            glGetShaderInfoLog(shader, i32InfoLogLength, &i32CharsWritten, pszInfoLog);
+
+            // Displays the error
+            printf("Failed to compile %s: %s\n", filename, pszInfoLog);
+            delete [] pszInfoLog;
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        return shader;
+    }
+
+    GLuint m_program;
+    GLuint m_vertShader, m_fragShader;
+
+    GLint m_locations[NUM_UNIFORMS];
+
+    // last value set for each uniform, for filtering redundant updates
+    GLfloat m_values[NUM_UNIFORMS][16];
+    bool m_cached[NUM_UNIFORMS];
+};
+
+
+#endif // __SG_SHADER_PROGRAM_H__
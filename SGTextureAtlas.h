@@ -0,0 +1,214 @@
+/*******************************************************************************
+
+ SGTextureAtlas
+
+ Notes: Packs small images into a few large textures (pages), so sprites
+ from many different files can be drawn with one texture bound and share a
+ draw call. Images are placed on shelves: horizontal strips as tall as the
+ first image put on them, filled left to right. An image goes on the shelf
+ it fits with the least wasted height; a new shelf is opened above the
+ last one when none fits, or when the best one is over twice its height.
+ A page is deleted once every image on it has been removed, so space is
+ reclaimed a whole page at a time.
+
+ Each image is stored with a one pixel border copied from its edges, so
+ linear filtering at the edge of a sprite never picks up its neighbours.
+
+ GL thread only.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_TEXTURE_ATLAS_H__
+#define __SG_TEXTURE_ATLAS_H__
+
+
+#include <vector>
+#include "STImage.h"
+#include "STTexture.h"
+
+
+class SGTextureAtlas
+{
+public:
+
+    // side of a page, in pixels
+    static const int PAGE_SIZE = 2048;
+    // images larger than this along either side get a texture of their own
+    static const int MAX_IMAGE_SIZE = 256;
+
+    // where an image went
+    struct Region
+    {
+        // NULL if the image is not in the atlas
+        STTexture *page;
+        // bottom-left corner and size in pixels, not counting the border
+        int x, y, width, height;
+        // the same rectangle in texture coordinates
+        float u0, v0, u1, v1;
+    };
+
+    SGTextureAtlas() { }
+
+    ~SGTextureAtlas()
+    {
+        for(size_t p = 0; p < m_pages.size(); p++)
+            delete m_pages[p].texture;
+    }
+
+    // whether an image of this size may go into the atlas
+    static bool accepts(const STImage *image)
+    {
+        return image->GetWidth() <= MAX_IMAGE_SIZE &&
+            image->GetHeight() <= MAX_IMAGE_SIZE;
+    }
+
+    // copy image into a page, adding a page if none has room
+    // returns false, leaving region.page NULL, if the image is too big
+    bool add(const STImage *image, Region &region)
+    {
+        region.page = NULL;
+        if(!accepts(image))
+            return false;
+
+        int w = image->GetWidth() + 2;
+        int h = image->GetHeight() + 2;
+
+        size_t p = 0;
+        int x = 0, y = 0;
+        for(; p < m_pages.size(); p++)
+        {
+            if(place(m_pages[p], w, h, x, y))
+                break;
+        }
+
+        if(p == m_pages.size())
+        {
+            Page page;
+            page.texture = new STTexture();
+            page.texture->Allocate(PAGE_SIZE, PAGE_SIZE);
+            page.top = 0;
+            page.numImages = 0;
+            m_pages.push_back(page);
+            place(m_pages[p], w, h, x, y);
+        }
+
+        STImage bordered(w, h);
+        copyWithBorder(image, &bordered);
+        m_pages[p].texture->LoadImageSubData(&bordered, x, y);
+        m_pages[p].numImages++;
+
+        region.page = m_pages[p].texture;
+        region.x = x + 1;
+        region.y = y + 1;
+        region.width = image->GetWidth();
+        region.height = image->GetHeight();
+        region.u0 = (float) region.x / PAGE_SIZE;
+        region.v0 = (float) region.y / PAGE_SIZE;
+        region.u1 = (float) (region.x + region.width) / PAGE_SIZE;
+        region.v1 = (float) (region.y + region.height) / PAGE_SIZE;
+
+        return true;
+    }
+
+    // give back the space of an image from add()
+    void remove(const Region &region)
+    {
+        for(size_t p = 0; p < m_pages.size(); p++)
+        {
+            if(m_pages[p].texture != region.page)
+                continue;
+
+            if(--m_pages[p].numImages == 0)
+            {
+                delete m_pages[p].texture;
+                m_pages.erase(m_pages.begin() + p);
+            }
+            return;
+        }
+    }
+
+    // number of pages in use
+    size_t numPages() const { return m_pages.size(); }
+    // bytes of GL memory held by the pages
+    size_t residentBytes() const
+    {
+        return m_pages.size() * PAGE_SIZE * PAGE_SIZE * sizeof(STImage::Pixel);
+    }
+
+private:
+
+    struct Shelf
+    {
+        int y, height;
+        // left edge of the free space
+        int x;
+    };
+
+    struct Page
+    {
+        STTexture *texture;
+        std::vector<Shelf> shelves;
+        // y of the next shelf; the page is unused from here up
+        int top;
+        int numImages;
+    };
+
+    // find room for a w x h rectangle on page, returning its corner in x, y
+    // returns false if the page is full
+    static bool place(Page &page, int w, int h, int &x, int &y)
+    {
+        Shelf *best = NULL;
+        for(size_t s = 0; s < page.shelves.size(); s++)
+        {
+            Shelf &shelf = page.shelves[s];
+            if(shelf.height >= h && PAGE_SIZE - shelf.x >= w &&
+               (best == NULL || shelf.height < best->height))
+                best = &shelf;
+        }
+
+        bool roomForShelf = PAGE_SIZE - page.top >= h;
+        if(best == NULL || (best->height > 2*h && roomForShelf))
+        {
+            if(!roomForShelf)
+                return false;
+
+            Shelf shelf = { page.top, h, 0 };
+            page.shelves.push_back(shelf);
+            page.top += h;
+            best = &page.shelves.back();
+        }
+
+        x = best->x;
+        y = best->y;
+        best->x += w;
+        return true;
+    }
+
+    // copy src into the middle of dst, which is two pixels larger each way,
+    // and repeat the outermost pixels of src into the rest of dst
+    static void copyWithBorder(const STImage *src, STImage *dst)
+    {
+        int sw = src->GetWidth(), sh = src->GetHeight();
+        int dw = dst->GetWidth();
+        const STImage::Pixel *in = src->GetPixels();
+        STImage::Pixel *out = dst->GetPixels();
+
+        for(int y = 0; y < dst->GetHeight(); y++)
+        {
+            int sy = y == 0 ? 0 : (y > sh ? sh-1 : y-1);
+            const STImage::Pixel *row = in + (size_t) sy * sw;
+            STImage::Pixel *o = out + (size_t) y * dw;
+
+            o[0] = row[0];
+            for(int x = 0; x < sw; x++)
+                o[x+1] = row[x];
+            o[sw+1] = row[sw-1];
+        }
+    }
+
+    std::vector<Page> m_pages;
+};
+
+
+#endif // __SG_TEXTURE_ATLAS_H__
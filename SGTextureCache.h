@@ -0,0 +1,312 @@
+/*******************************************************************************
+
+ SGTextureCache
+
+ Notes: Shares one GL texture between every SGImage showing the same file.
+ Textures are keyed by path and modification time, so a file that changed
+ on disk is loaded again while objects created before the change keep the
+ old texture. Each texture is reference counted and deleted when its last
+ user releases it.
+
+ Images are requested at the pixel size they will be drawn at. Formats
+ that can decode at a reduced scale (JPEG) then produce textures no bigger
+ than needed: for them the size, clamped to the GL's largest texture and
+ rounded up to a power of two, is part of the key, so sprites of similar
+ size still share one texture. Other formats are always decoded at full
+ size, and keyed without a size, so a file has one texture however it is
+ drawn. acquireLarger() gets an image drawn bigger than it was decoded for
+ again, at the new size. Whether the texture is mipmapped is part of the
+ key too.
+
+ Small images without mipmaps are packed into an SGTextureAtlas instead of
+ getting a texture of their own; their entry's texture is then the atlas
+ page, and its region says where on the page the image is.
+
+ ETC1 compressed files (.pkm) stay compressed in GL memory if the GL
+ supports ETC1, and are decoded by the loader otherwise. Compressed
+ textures are never mipmapped or put in the atlas.
+
+ Images are decoded off the GL thread by an SGImageLoader. acquire()
+ returns at once with an entry whose texture stays NULL until update() has
+ uploaded the decoded pixels; update() is called once per frame and uploads
+ at most a given number of bytes, so a burst of new images is spread over
+ several frames. The decoded STImage is freed as soon as it is uploaded, so
+ only the GL copy of the pixels stays resident.
+
+ GL thread only.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_TEXTURE_CACHE_H__
+#define __SG_TEXTURE_CACHE_H__
+
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <sys/stat.h>
+#include "STImage.h"
+#include "STTexture.h"
+#include "SGImageLoader.h"
+#include "SGTextureAtlas.h"
+
+
+class SGTextureCache
+{
+private:
+
+    // path, modification time, target size and mipmapping
+    struct Key
+    {
+        std::string path;
+        time_t mtime;
+        int targetWidth, targetHeight;
+        bool mipmaps;
+
+        bool operator<(const Key &k) const
+        {
+            if(path != k.path) return path < k.path;
+            if(mtime != k.mtime) return mtime < k.mtime;
+            if(targetWidth != k.targetWidth) return targetWidth < k.targetWidth;
+            if(targetHeight != k.targetHeight) return targetHeight < k.targetHeight;
+            return mipmaps < k.mipmaps;
+        }
+    };
+
+public:
+
+    struct Entry
+    {
+        // NULL while the image is being decoded, or if it failed to load
+        STTexture *texture;
+        // region.page is NULL unless texture is an atlas page
+        SGTextureAtlas::Region region;
+
+        Key key;
+        size_t bytes;
+        int refs;
+        bool loading;
+    };
+
+    SGTextureCache() :
+    m_numHits(0),
+    m_numMisses(0),
+    m_residentBytes(0),
+    m_bytesUploaded(0)
+    { }
+
+    // decode images on numThreads background threads; without this, images
+    // are decoded synchronously by acquire()
+    void startLoader(int numThreads) { m_loader.start(numThreads); }
+
+    // the entry for the image file at path, to be drawn at
+    // targetWidth x targetHeight pixels (0 for full size), with mipmaps if
+    // mipmaps is set, queueing it for loading if it is not cached yet;
+    // every acquire() must be matched by a release()
+    const Entry *acquire(const std::string &path, int targetWidth = 0,
+                         int targetHeight = 0, bool mipmaps = false)
+    {
+        Key key;
+        key.path = path;
+        key.mtime = modificationTime(path);
+        key.targetWidth = key.targetHeight = 0;
+        if(STImage::DecodesScaled(path))
+        {
+            key.targetWidth = sizeBucket(targetWidth);
+            key.targetHeight = sizeBucket(targetHeight);
+        }
+        key.mipmaps = mipmaps;
+
+        EntryMap::iterator i = m_entries.find(key);
+        if(i != m_entries.end())
+        {
+            m_numHits++;
+            i->second.refs++;
+            return &i->second;
+        }
+
+        m_numMisses++;
+
+        Entry &entry = m_entries[key];
+        entry.texture = NULL;
+        entry.region.page = NULL;
+        entry.key = key;
+        entry.bytes = 0;
+        entry.refs = 1;
+        entry.loading = true;
+
+        m_loader.load(path, key.targetWidth, key.targetHeight,
+            STTexture::SupportsETC1(), &entry);
+
+        return &entry;
+    }
+
+    // an entry for the same image as entry, big enough to be drawn at
+    // targetWidth x targetHeight pixels, or NULL if entry already is;
+    // a returned entry must be released like one from acquire()
+    const Entry *acquireLarger(const Entry *entry, int targetWidth,
+                               int targetHeight)
+    {
+        // decoded at full size already (as every format but JPEG is)
+        const Key &key = entry->key;
+        if(key.targetWidth == 0 && key.targetHeight == 0)
+            return NULL;
+
+        int width = sizeBucket(targetWidth), height = sizeBucket(targetHeight);
+        if(width <= key.targetWidth && height <= key.targetHeight)
+            return NULL;
+
+        return acquire(key.path, std::max(width, key.targetWidth),
+            std::max(height, key.targetHeight), key.mipmaps);
+    }
+
+    // give back an entry from acquire(), deleting its texture if nothing
+    // else uses it
+    void release(const Entry *entry)
+    {
+        Entry *e = const_cast<Entry *>(entry);
+        e->refs--;
+
+        // an entry still loading is erased once the load finishes
+        if(e->refs == 0 && !e->loading)
+            erase(e);
+    }
+
+    // upload decoded images to GL, stopping once budgetBytes (> 0) have been
+    // uploaded; call once per frame
+    void update(size_t budgetBytes)
+    {
+        m_bytesUploaded = 0;
+
+        SGImageLoader::Result result;
+        while(m_bytesUploaded < budgetBytes && m_loader.poll(result))
+        {
+            Entry *entry = (Entry *) result.tag;
+            entry->loading = false;
+
+            if(entry->refs == 0)
+            {
+                // every user went away while it was loading
+                delete result.image;
+                delete result.compressed;
+                erase(entry);
+                continue;
+            }
+
+            if(result.compressed != NULL)
+            {
+                entry->texture = new STTexture(result.compressed);
+                entry->bytes = result.compressed->GetDataSize();
+                delete result.compressed;
+
+                m_residentBytes += entry->bytes;
+                m_bytesUploaded += entry->bytes;
+                continue;
+            }
+
+            if(result.image == NULL)
+                continue;
+
+            entry->bytes = (size_t) result.image->GetWidth() *
+                result.image->GetHeight() * sizeof(STImage::Pixel);
+
+            if(!entry->key.mipmaps && m_atlas.add(result.image, entry->region))
+            {
+                // the atlas pages are counted as a whole by residentBytes()
+                entry->texture = entry->region.page;
+            }
+            else
+            {
+                entry->texture = new STTexture(result.image, entry->key.mipmaps ?
+                    STTexture::kGenerateMipmaps : STTexture::kNone);
+                // the mipmap chain adds a third
+                if(entry->key.mipmaps)
+                    entry->bytes += entry->bytes / 3;
+                m_residentBytes += entry->bytes;
+            }
+            delete result.image;
+
+            m_bytesUploaded += entry->bytes;
+        }
+    }
+
+    // number of acquire() calls that found the image already cached
+    size_t numHits() const { return m_numHits; }
+    // number of acquire() calls that had to load the image
+    size_t numMisses() const { return m_numMisses; }
+    // bytes of pixel data held in textures, including whole atlas pages
+    size_t residentBytes() const
+    {
+        return m_residentBytes + m_atlas.residentBytes();
+    }
+    // number of atlas pages small images are packed into
+    size_t numAtlasPages() const { return m_atlas.numPages(); }
+    // bytes of pixel data uploaded by the last update()
+    size_t bytesUploaded() const { return m_bytesUploaded; }
+    // number of images waiting to be decoded or uploaded
+    size_t numPending() const { return m_loader.numPending(); }
+    // number of distinct images held
+    size_t size() const { return m_entries.size(); }
+
+private:
+
+    typedef std::map<Key, Entry> EntryMap;
+
+    void erase(Entry *entry)
+    {
+        if(entry->region.page != NULL)
+            m_atlas.remove(entry->region);
+        else if(entry->texture != NULL)
+        {
+            m_residentBytes -= entry->bytes;
+            delete entry->texture;
+        }
+        Key key = entry->key;
+        m_entries.erase(key);
+    }
+
+    // the smallest power of two >= size, or the largest texture size if
+    // that is smaller; 0 for no size
+    static int sizeBucket(int size)
+    {
+        if(size <= 0)
+            return 0;
+
+        int maxSize = STTexture::MaxSize();
+        if(maxSize <= 0)
+            maxSize = MAX_TARGET_SIZE;
+        if(size > maxSize)
+            size = maxSize;
+
+        int bucket = 1;
+        while(bucket < size)
+            bucket <<= 1;
+        return bucket;
+    }
+
+    // cap on target sizes if the GL doesn't say
+    enum { MAX_TARGET_SIZE = 1 << 14 };
+
+    // 0 if the file can't be stat'ed; loading it will report the error
+    static time_t modificationTime(const std::string &path)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+            return 0;
+        return st.st_mtime;
+    }
+
+    // entries are never moved, so Entry pointers stay valid until erased
+    EntryMap m_entries;
+    SGImageLoader m_loader;
+    SGTextureAtlas m_atlas;
+
+    size_t m_numHits;
+    size_t m_numMisses;
+    size_t m_residentBytes;
+    size_t m_bytesUploaded;
+};
+
+
+#endif // __SG_TEXTURE_CACHE_H__
@@ -14,6 +14,10 @@
 ******************************************************************************/
 #include <stdio.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
 
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
@@ -27,9 +31,19 @@
 #include <assert.h>
 #include <algorithm>
 #include <map>
-#include "CircularBuffer.h"
+#include <vector>
+#include "SGMessageQueue.h"
+#include "SGPixelRing.h"
+#include "SGCoalescer.h"
+#include "SGScheduler.h"
+#include "SGOscDispatcher.h"
+#include "SGIdTable.h"
+#include "SGPattern.h"
+#include "SGShaderProgram.h"
+#include "SGTextureCache.h"
 #include "STTexture.h"
 #include "STImage.h"
+#include "STPixelConvert.h"
 
 #include "osc/OscReceivedElements.h"
 #include "osc/OscPacketListener.h"
@@ -39,50 +53,47 @@
 #include  "bcm_host.h"
 #endif
 
-// Index to bind the attributes to vertex shaders
-#define VERTEX_ARRAY    0
 
-
-struct SGMessage
+// Vertex layout of the batch renderer: position plus per-vertex color, so
+// primitives of different colors can share a draw call, plus the shape
+// coordinate of analytic ellipses (0 for everything else) and the texture
+// coordinate of sprites in a texture atlas (0 for untextured primitives)
+struct SGVertex
 {
-    enum Type
-    {
-        LINE,
-        TRIANGLE,
-        RECT,
-        ELLIPSE,
-        IMAGE,
-        TEXT,
-        REMOVE,
-        
-        POSITION,
-        SIZE,
-        COLOR,
-        RED,
-        GREEN,
-        BLUE,
-        ALPHA,
-    };
-    
-    Type type;
-    std::string objectId;
-    
-    STPoint2 position;
-    STPoint2 size;
-    STPoint2 vertex3;
-    STColor4f color;
-    std::string str;
+    GLfloat x, y;
+    GLubyte r, g, b, a;
+    GLbyte s, t;
+    GLbyte pad[2];
+    GLushort u, v;
 };
 
+// normalized GL_BYTE values that map to exactly -1 and 1
+#define SHAPE_COORD_MIN -128
+#define SHAPE_COORD_MAX 127
+
+static inline GLushort texCoordShort(float c)
+{
+    return c <= 0 ? 0 : (c >= 1 ? 65535 : (GLushort) (c*65535.0f + 0.5f));
+}
+
+static inline GLubyte colorByte(float c)
+{
+    return c <= 0 ? 0 : (c >= 1 ? 255 : (GLubyte) (c*255.0f + 0.5f));
+}
+
+
 class SGObject
 {
 public:
     SGObject()
     {
-        program = 0;
+        program = NULL;
         geo = NULL;
         numVertex = 0;
         vbo = 0;
+        vboSize = 0;
+        dirty = true;
+        m_handle = 0;
         
         glGenBuffers(1, &vbo);
     }
@@ -92,13 +103,16 @@ public:
         glDeleteBuffers(1, &vbo);
     }
     
-    void setShaderProgram(GLuint p)
+    void setShaderProgram(SGShaderProgram *p)
     {
         program = p;
     }
 
     virtual void processMessage(const SGMessage &msg)
     {
+        // any message may change how the object looks
+        dirty = true;
+        
         switch(msg.type)
         {
             case SGMessage::COLOR:
@@ -109,7 +123,8 @@ public:
             case SGMessage::IMAGE:
             case SGMessage::TEXT:
             {
-                color = msg.color;
+                color = STColor4f(msg.color.r, msg.color.g, msg.color.b,
+                    msg.color.a);
             }
             break;
             case SGMessage::RED:
@@ -137,48 +152,119 @@ public:
         }
     }
 
+    // draw this object on its own (the unbatched path)
     virtual void render()
     {
         if(numVertex == 0 || geo == NULL) return;
         // set color
-        int location = glGetUniformLocation(program, "color");
-        glUniform4f(location, color.r, color.g, color.b, color.a);
-        location = glGetUniformLocation(program, "texOffset");
-        glUniform4f(location, 1, 1, 1, 1);
+        program->uniform4f(SGShaderProgram::COLOR, color.r, color.g, color.b, color.a);
+        program->uniform4f(SGShaderProgram::TEX_OFFSET, 1, 1, 1, 1);
         
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, numVertex * (sizeof(GLfloat) * 2), geo, GL_STATIC_DRAW);
+        if(dirty)
+            uploadGeometry();
         glEnableVertexAttribArray(VERTEX_ARRAY);
         glVertexAttribPointer(VERTEX_ARRAY, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glDisableVertexAttribArray(COLOR_ARRAY);
+        glVertexAttrib4f(COLOR_ARRAY, 1, 1, 1, 1);
+        glDisableVertexAttribArray(TEXCOORD_ARRAY);
+        bindShapeCoords();
         
         glActiveTexture(GL_TEXTURE0);
         glEnable(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, 0);
-        GLuint textureUniform = glGetUniformLocation(program, "tex");
-        glUniform1i(textureUniform, 0);
+        program->uniform1i(SGShaderProgram::TEX, 0);
         
-        glDrawArrays(GL_TRIANGLES, 0, numVertex);
+        glDrawArrays(primitiveMode(), 0, numVertex);
+    }
+    
+    // whether this object can be drawn by SGBatch, i.e. it is fully
+    // described by primitiveMode(), batchTexture() and appendVertices()
+    virtual bool batchable() { return true; }
+    
+    virtual GLenum primitiveMode() { return GL_TRIANGLES; }
+    
+    // the texture the batch has to bind to draw this object, or NULL for
+    // untextured objects
+    virtual STTexture *batchTexture() { return NULL; }
+    
+    int vertexCount() { return (geo == NULL) ? 0 : numVertex; }
+    
+    // write vertexCount() vertices, with this object's color, to out
+    virtual void appendVertices(SGVertex *out)
+    {
+        GLubyte r = colorByte(color.r), g = colorByte(color.g),
+            b = colorByte(color.b), a = colorByte(color.a);
+        
+        for(int i = 0; i < numVertex; i++)
+        {
+            out[i].x = geo[i*2];
+            out[i].y = geo[i*2+1];
+            out[i].r = r; out[i].g = g; out[i].b = b; out[i].a = a;
+            out[i].s = out[i].t = 0;
+            out[i].u = out[i].v = 0;
+        }
     }
     
+    // true if the object changed since its vertices were last uploaded
+    bool isDirty() { return dirty; }
+    void clearDirty() { dirty = false; }
+    
     const std::string &id() { return m_id; }
+    // the SGIdTable handle of id()
+    unsigned handle() { return m_handle; }
+    void setId(const std::string &i, unsigned handle) { m_id = i; m_handle = handle; }
 
     static int SCREEN_WIDTH;
     static int SCREEN_HEIGHT;
+    
+    // bytes of vertex data sent to GL in the current frame
+    static size_t bytesUploaded;
 
 protected:
+    
+    // size in bytes of the geo array
+    virtual size_t geoBytes() { return numVertex * (sizeof(GLfloat) * 2); }
+    
+    // set up the shape coordinate attribute for render(), with this
+    // object's VBO bound; by default every fragment is inside the shape
+    virtual void bindShapeCoords()
+    {
+        glDisableVertexAttribArray(SHAPE_ARRAY);
+        glVertexAttrib2f(SHAPE_ARRAY, 0, 0);
+    }
+    
+    // copy geo into this object's own VBO, which must be bound; the VBO is
+    // only reallocated when geo has grown
+    void uploadGeometry()
+    {
+        size_t bytes = geoBytes();
+        if(bytes > vboSize)
+        {
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+            vboSize = bytes;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, geo);
+        bytesUploaded += bytes;
+        dirty = false;
+    }
 
     GLuint vbo;
+    size_t vboSize;
     GLfloat *geo;
     int numVertex;
     STColor4f color;
-    GLuint program;
+    SGShaderProgram *program;
+    bool dirty;
         
 private:
     std::string m_id;
+    unsigned m_handle;
 };
 
 int SGObject::SCREEN_WIDTH = 0;
 int SGObject::SCREEN_HEIGHT = 0;
+size_t SGObject::bytesUploaded = 0;
 
 class SGRectangle : public SGObject
 {
@@ -213,7 +299,7 @@ public:
                 setPosition(msg.position.x, msg.position.y);
             break;
             case SGMessage::SIZE:
-                setPosition(msg.size.x, msg.size.y);
+                setSize(msg.size.x, msg.size.y);
             break;
             default:
             break;
@@ -222,6 +308,7 @@ public:
     
     void setDimensions(float _x, float _y, float _width, float _height)
     {
+        dirty = true;
         x = _x; y = _y;
         width = _width; height = _height;
         
@@ -238,6 +325,7 @@ public:
     
     void setPosition(float _x, float _y)
     {
+        dirty = true;
         x = _x; y = _y;
         
         float width_2 = width/2.0;
@@ -253,6 +341,7 @@ public:
     
     void setSize(float _width, float _height)
     {
+        dirty = true;
         width = _width; height = _height;
         
         float width_2 = width/2.0;
@@ -270,6 +359,12 @@ protected:
     float x, y, width, height;
 };
 
+// An ellipse is drawn analytically by default: one quad covering its
+// bounding box, whose corners carry shape coordinates (+-1, +-1), and the
+// fragment shader drops everything outside the unit circle. Moving or
+// resizing it only recomputes four corners. With tessellated set, it is
+// instead drawn as a fan of triangles computed on the CPU, with as many
+// segments as its size on screen needs.
 class SGEllipse : public SGObject
 {
 public:
@@ -277,9 +372,14 @@ public:
     {
         x = _x; y = _y;
         width = _width; height = _height;
-        tris = 80;
-        numVertex = tris*3;
-        geo = new GLfloat[tris*3*2];
+        tris = 0;
+        if(!tessellated)
+        {
+            // positions, followed by the shape coordinates
+            numVertex = 6;
+            geo = new GLfloat[6*2*2];
+            memcpy(geo + 6*2, QUAD, sizeof(QUAD));
+        }
         setDimensions(x, y, width, height);
     }
     
@@ -304,74 +404,181 @@ public:
                 setPosition(msg.position.x, msg.position.y);
             break;
             case SGMessage::SIZE:
-                setPosition(msg.size.x, msg.size.y);
+                setSize(msg.size.x, msg.size.y);
             break;
             default:
             break;
         }
     }
     
+    virtual void appendVertices(SGVertex *out)
+    {
+        SGObject::appendVertices(out);
+        
+        if(!tessellated)
+        {
+            for(int i = 0; i < numVertex; i++)
+            {
+                out[i].s = QUAD[i*2] < 0 ? SHAPE_COORD_MIN : SHAPE_COORD_MAX;
+                out[i].t = QUAD[i*2+1] < 0 ? SHAPE_COORD_MIN : SHAPE_COORD_MAX;
+            }
+        }
+    }
+    
     void setDimensions(float _x, float _y, float _width, float _height)
     {
+        dirty = true;
         x = _x; y = _y;
         width = _width; height = _height;
-
-        for(int i = 0; i < tris; i++)
-        {
-            float theta = ((float) i)/tris*2*M_PI;
-            float theta_plus_one = ((float) i+1)/tris*2*M_PI;
-            geo[i*6] = x;
-            geo[i*6+1] = y;
-            geo[i*6+2] = x+width*0.5f*cosf(theta);
-            geo[i*6+3] = y+height*0.5f*sinf(theta);
-            geo[i*6+4] = x+width*0.5f*cosf(theta_plus_one);
-            geo[i*6+5] = y+height*0.5f*sinf(theta_plus_one);
-        }
+        updateGeometry();
     }
     
     void setPosition(float _x, float _y)
     {
+        dirty = true;
         x = _x; y = _y;
-
-        for(int i = 0; i < tris; i++)
-        {
-            float theta = ((float) i)/tris*2*M_PI;
-            float theta_plus_one = ((float) i+1)/tris*2*M_PI;
-            geo[i*6] = x;
-            geo[i*6+1] = y;
-            geo[i*6+2] = x+width*0.5f*cosf(theta);
-            geo[i*6+3] = y+height*0.5f*sinf(theta);
-            geo[i*6+4] = x+width*0.5f*cosf(theta_plus_one);
-            geo[i*6+5] = y+height*0.5f*sinf(theta_plus_one);
-        }
+        updateGeometry();
     }
     
     void setSize(float _width, float _height)
     {
+        dirty = true;
         width = _width; height = _height;
-
+        updateGeometry();
+    }
+    
+    // draw ellipses as CPU-tessellated triangle fans instead of analytically
+    // (set by -t before any ellipse exists; it must not change after that,
+    // since existing ellipses' geometry is laid out for one mode or the other)
+    static bool tessellated;
+    
+protected:
+    
+    virtual size_t geoBytes()
+    {
+        return SGObject::geoBytes() * (tessellated ? 1 : 2);
+    }
+    
+    virtual void bindShapeCoords()
+    {
+        if(tessellated)
+        {
+            SGObject::bindShapeCoords();
+            return;
+        }
+        
+        glEnableVertexAttribArray(SHAPE_ARRAY);
+        glVertexAttribPointer(SHAPE_ARRAY, 2, GL_FLOAT, GL_FALSE, 0,
+            (GLvoid*) (sizeof(GLfloat)*numVertex*2));
+    }
+    
+    void updateGeometry()
+    {
+        if(!tessellated)
+        {
+            for(int i = 0; i < 6; i++)
+            {
+                geo[i*2] = x+width*0.5f*QUAD[i*2];
+                geo[i*2+1] = y+height*0.5f*QUAD[i*2+1];
+            }
+            return;
+        }
+        
+        int segments = segmentsFor(width, height);
+        if(segments != tris)
+        {
+            delete[] geo;
+            tris = segments;
+            numVertex = tris*3;
+            geo = new GLfloat[tris*3*2];
+        }
+        
+        const GLfloat *circle = unitCircle();
+        int step = MAX_SEGMENTS / tris;
         for(int i = 0; i < tris; i++)
         {
-            float theta = ((float) i)/tris*2*M_PI;
-            float theta_plus_one = ((float) i+1)/tris*2*M_PI;
+            const GLfloat *p0 = circle + i*step*2;
+            const GLfloat *p1 = circle + (i+1)*step*2;
             geo[i*6] = x;
             geo[i*6+1] = y;
-            geo[i*6+2] = x+width*0.5f*cosf(theta);
-            geo[i*6+3] = y+height*0.5f*sinf(theta);
-            geo[i*6+4] = x+width*0.5f*cosf(theta_plus_one);
-            geo[i*6+5] = y+height*0.5f*sinf(theta_plus_one);
+            geo[i*6+2] = x+width*0.5f*p0[0];
+            geo[i*6+3] = y+height*0.5f*p0[1];
+            geo[i*6+4] = x+width*0.5f*p1[0];
+            geo[i*6+5] = y+height*0.5f*p1[1];
         }
     }
     
-protected:
+    // number of fan segments for an ellipse of the given size: enough that
+    // the polygon strays at most MAX_ERROR pixels from the true outline, as
+    // a power of two in [MIN_SEGMENTS, MAX_SEGMENTS] so the segments are an
+    // even subset of unitCircle()
+    static int segmentsFor(float w, float h)
+    {
+        // the projection maps one unit to SCREEN_HEIGHT pixels along both
+        // axes (x is scaled by the aspect SCREEN_WIDTH/SCREEN_HEIGHT)
+        float radius = std::max(fabsf(w), fabsf(h)) * 0.5f * SCREEN_HEIGHT;
+        
+        // a chord spanning angle a is at most r*(1 - cos(a/2)) inside the
+        // circle
+        int segments = MIN_SEGMENTS;
+        if(radius > MAX_ERROR)
+        {
+            float needed = M_PI / acosf(1 - MAX_ERROR/radius);
+            while(segments < needed && segments < MAX_SEGMENTS)
+                segments *= 2;
+        }
+        
+        return segments;
+    }
+    
+    // (cos, sin) at MAX_SEGMENTS+1 evenly spaced angles around the circle,
+    // the last repeating the first; built on first use and shared by all
+    // ellipses
+    static const GLfloat *unitCircle()
+    {
+        static GLfloat circle[(MAX_SEGMENTS+1)*2];
+        static bool built = false;
+        
+        if(!built)
+        {
+            for(int i = 0; i < MAX_SEGMENTS; i++)
+            {
+                float theta = ((float) i)/MAX_SEGMENTS*2*M_PI;
+                circle[i*2] = cosf(theta);
+                circle[i*2+1] = sinf(theta);
+            }
+            circle[MAX_SEGMENTS*2] = circle[0];
+            circle[MAX_SEGMENTS*2+1] = circle[1];
+            built = true;
+        }
+        
+        return circle;
+    }
+    
+    enum { MIN_SEGMENTS = 8, MAX_SEGMENTS = 256 };
+    // allowed distance, in pixels, between the fan and the true outline
+    static const float MAX_ERROR;
+    
+    // corners of the bounding quad, as two triangles, in shape coordinates
+    static const GLfloat QUAD[6*2];
+    
     int tris;
     float x, y, width, height;
 };
 
+bool SGEllipse::tessellated = false;
+const float SGEllipse::MAX_ERROR = 0.25f;
+const GLfloat SGEllipse::QUAD[6*2] =
+{
+    -1, -1,   1, -1,   1, 1,
+    -1, -1,   1, 1,   -1, 1,
+};
+
 class SGImage : public SGObject
 {
 public:
-    SGImage(const std::string &imageFile, float _x, float _y, float _width, float _height)
+    SGImage(const std::string &imageFile, float _x, float _y, float _width, float _height,
+        bool mipmaps)
     {
         x = _x; y = _y;
         width = _width; height = _height;
@@ -381,16 +588,14 @@ public:
         setDimensions(x, y, width, height);
         
         uv = geo + 2*numVertex;
+        memcpy(uv, UNIT_UV, sizeof(UNIT_UV));
+        mappedTexture = NULL;
+        streamTexture = NULL;
+        larger = NULL;
         
-        uv[0]  = 0; uv[1]  = 0;
-        uv[2]  = 1; uv[3]  = 0;
-        uv[4]  = 0; uv[5]  = 1;
-        uv[6]  = 1; uv[7]  = 0;
-        uv[8]  = 0; uv[9]  = 1;
-        uv[10] = 1; uv[11] = 1;
-        
-        image = new STImage(imageFile.c_str());
-        texture = new STTexture(image);
+        // the image is decoded no larger than it is first drawn
+        cached = textures.acquire(imageFile, pixelSize(width),
+            pixelSize(height), mipmaps);
     }
     
     virtual ~SGImage()
@@ -398,8 +603,10 @@ public:
         delete[] geo;
         geo = NULL;
         numVertex = 0;
-        delete texture;
-        delete image;
+        textures.release(cached);
+        if(larger != NULL)
+            textures.release(larger);
+        delete streamTexture;
     }
     
     virtual void processMessage(const SGMessage &msg)
@@ -411,54 +618,90 @@ public:
             case SGMessage::IMAGE:
                 setDimensions(msg.position.x, msg.position.y, 
                     msg.size.x, msg.size.y);
+                acquireLarger();
             break;
             case SGMessage::POSITION:
                 setPosition(msg.position.x, msg.position.y);
             break;
             case SGMessage::SIZE:
-                setPosition(msg.size.x, msg.size.y);
+                setSize(msg.size.x, msg.size.y);
+                acquireLarger();
+            break;
+            case SGMessage::SUBIMAGE:
+                updatePixels(msg);
             break;
             default:
             break;
         }
     }
     
+    // images packed into a texture atlas are drawn by the batch; others
+    // have to bind their own texture
+    virtual bool batchable()
+    {
+        const SGTextureCache::Entry *e = entry();
+        return streamTexture == NULL && e->texture != NULL &&
+            e->region.page != NULL;
+    }
+    
+    virtual STTexture *batchTexture() { return entry()->texture; }
+    
+    virtual void appendVertices(SGVertex *out)
+    {
+        SGObject::appendVertices(out);
+        mapTexCoords();
+        
+        for(int i = 0; i < numVertex; i++)
+        {
+            out[i].u = texCoordShort(uv[i*2]);
+            out[i].v = texCoordShort(uv[i*2+1]);
+        }
+    }
+    
+    virtual size_t geoBytes() { return numVertex * 2 * (sizeof(GLfloat) * 2); }
+    
     virtual void render()
     {
         if(numVertex == 0 || geo == NULL) return;
         
-        GLuint texCoordSlot = glGetAttribLocation(program, "texCoordIn");
-        glEnableVertexAttribArray(texCoordSlot);
-        GLuint textureUniform = glGetUniformLocation(program, "tex");
+        // nothing to draw until the image has been decoded and uploaded
+        STTexture *texture = currentTexture();
+        if(texture == NULL) return;
+        mapTexCoords();
+        
+        glEnableVertexAttribArray(TEXCOORD_ARRAY);
         
         // set color
-        int location = glGetUniformLocation(program, "color");
-        glUniform4f(location, color.r, color.g, color.b, color.a);
-        location = glGetUniformLocation(program, "texOffset");
-        glUniform4f(location, 0, 0, 0, 0);
+        program->uniform4f(SGShaderProgram::COLOR, color.r, color.g, color.b, color.a);
+        program->uniform4f(SGShaderProgram::TEX_OFFSET, 0, 0, 0, 0);
         
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, numVertex * 2 * (sizeof(GLfloat) * 2), 
-            geo, GL_STATIC_DRAW);
+        if(dirty)
+            uploadGeometry();
         glEnableVertexAttribArray(VERTEX_ARRAY);
         glVertexAttribPointer(VERTEX_ARRAY, 2, GL_FLOAT, GL_FALSE, 0, 0);
         
-        glVertexAttribPointer(texCoordSlot, 2, GL_FLOAT, GL_FALSE, 0, 
+        glVertexAttribPointer(TEXCOORD_ARRAY, 2, GL_FLOAT, GL_FALSE, 0, 
             (GLvoid*) (sizeof(GLfloat)*numVertex*2));
+        glDisableVertexAttribArray(COLOR_ARRAY);
+        glVertexAttrib4f(COLOR_ARRAY, 1, 1, 1, 1);
+        glDisableVertexAttribArray(SHAPE_ARRAY);
+        glVertexAttrib2f(SHAPE_ARRAY, 0, 0);
         
         glEnable(GL_TEXTURE_2D);
         glActiveTexture(GL_TEXTURE0);
         texture->Bind();
-        glUniform1i(textureUniform, 0);
+        program->uniform1i(SGShaderProgram::TEX, 0);
         
         glDrawArrays(GL_TRIANGLES, 0, numVertex);
         
         texture->UnBind();
-        glDisableVertexAttribArray(texCoordSlot);
+        glDisableVertexAttribArray(TEXCOORD_ARRAY);
     }
     
     void setDimensions(float _x, float _y, float _width, float _height)
     {
+        dirty = true;
         x = _x; y = _y;
         width = _width; height = _height;
         
@@ -475,6 +718,7 @@ public:
     
     void setPosition(float _x, float _y)
     {
+        dirty = true;
         x = _x; y = _y;
         
         float width_2 = width/2.0;
@@ -490,6 +734,7 @@ public:
     
     void setSize(float _width, float _height)
     {
+        dirty = true;
         width = _width; height = _height;
         
         float width_2 = width/2.0;
@@ -503,11 +748,177 @@ public:
         geo[10] = x+width_2; geo[11] = y+height_2;
     }
     
+    // textures shared by all images showing the same file
+    static SGTextureCache textures;
+    // mipmap images that don't say whether to
+    static bool mipmapsByDefault;
+    // the largest texture the GL can make, at most MAX_PIXEL_SIZE; set
+    // before the OSC thread starts, which checks frames against it
+    static int maxTextureSize;
+    // where the OSC thread puts streamed pixels
+    static SGPixelRing *pixelRing;
+    
 protected:
+    // replace a rectangle of the image's pixels, uploading them straight
+    // from the pixel ring. The shared texture from the cache is never
+    // written to: the first update gives the image a texture of its own.
+    // /sg/pixels frames size it to the frame; for /sg/subimage it starts
+    // out as a copy of the shared one. An ETC1 texture can't be copied
+    // (the GL can't render to it), so /sg/subimage is refused for those.
+    void updatePixels(const SGMessage &msg)
+    {
+        int px = (int) msg.position.x, py = (int) msg.position.y;
+        int pw = (int) msg.size.x, ph = (int) msg.size.y;
+        const STColor4ub *pixels = (const STColor4ub *) pixelRing->at(msg.pixels);
+        
+        if(msg.frameWidth > 0)
+        {
+            if(streamTexture == NULL)
+                streamTexture = new STTexture();
+            
+            if(streamTexture->GetWidth() != msg.frameWidth ||
+               streamTexture->GetHeight() != msg.frameHeight)
+            {
+                // the first tile of a frame of a new size: until the other
+                // tiles arrive the rest is transparent
+                streamTexture->Allocate(msg.frameWidth, msg.frameHeight);
+                if(!msg.replacesFrame())
+                    streamTexture->Clear();
+            }
+        }
+        else if(streamTexture == NULL)
+        {
+            const STTexture *shared = entry()->texture;
+            if(shared != NULL && shared->IsCompressed())
+            {
+                std::cout << "error: /sg/subimage can't update compressed image "
+                    << entry()->key.path << "\n";
+                return;
+            }
+            
+            streamTexture = new STTexture();
+            
+            const SGTextureAtlas::Region &region = entry()->region;
+            if(shared == NULL)
+            {
+                // not loaded (yet): start out transparent, just big
+                // enough for the update
+                streamTexture->Allocate(px + pw, py + ph);
+                streamTexture->Clear();
+            }
+            else if(region.page != NULL)
+                streamTexture->CopyTextureData(shared, region.x, region.y,
+                    region.width, region.height);
+            else
+                streamTexture->CopyTextureData(shared, 0, 0,
+                    shared->GetWidth(), shared->GetHeight());
+        }
+        
+        streamTexture->UpdateImageData(px, py, pw, ph, pixels);
+    }
+    
+    // the texture to draw with: the image's own once it has been written
+    // to, otherwise the shared one (NULL while that is loading)
+    STTexture *currentTexture()
+    {
+        return streamTexture != NULL ? streamTexture : entry()->texture;
+    }
+    
+    // the cache entry to draw from: the one decoded at a larger size, as
+    // soon as it has loaded
+    const SGTextureCache::Entry *entry()
+    {
+        if(larger != NULL && !larger->loading)
+        {
+            // keep the old texture if the new one failed to load
+            if(larger->texture != NULL)
+                std::swap(cached, larger);
+            textures.release(larger);
+            larger = NULL;
+            mappedTexture = NULL;
+        }
+        
+        return cached;
+    }
+    
+    // load the image again if it is drawn bigger than it was decoded for;
+    // the old texture is drawn until the new one is there
+    void acquireLarger()
+    {
+        if(streamTexture != NULL)
+            return;
+        
+        const SGTextureCache::Entry *e = textures.acquireLarger(
+            larger != NULL ? larger : cached, pixelSize(width), pixelSize(height));
+        if(e == NULL)
+            return;
+        
+        if(larger != NULL)
+            textures.release(larger);
+        larger = e;
+    }
+    
+    // the number of pixels a size in scene units is drawn across: the
+    // projection maps one unit to SCREEN_HEIGHT pixels along both axes
+    static int pixelSize(float size)
+    {
+        float pixels = ceilf(fabsf(size) * SCREEN_HEIGHT);
+        if(!(pixels >= 0))
+            return 0; // NaN
+        return pixels < MAX_PIXEL_SIZE ? (int) pixels : MAX_PIXEL_SIZE;
+    }
+    
+    enum { MAX_PIXEL_SIZE = 32767 };
+    
+    // once the texture is there, point the texture coordinates at the
+    // image's region of it: all of it, or its rectangle in an atlas page
+    void mapTexCoords()
+    {
+        if(currentTexture() == mappedTexture)
+            return;
+        
+        const SGTextureAtlas::Region &region = entry()->region;
+        for(int i = 0; i < numVertex; i++)
+        {
+            if(streamTexture == NULL && region.page != NULL)
+            {
+                uv[i*2]   = region.u0 + UNIT_UV[i*2]   * (region.u1 - region.u0);
+                uv[i*2+1] = region.v0 + UNIT_UV[i*2+1] * (region.v1 - region.v0);
+            }
+            else
+            {
+                uv[i*2]   = UNIT_UV[i*2];
+                uv[i*2+1] = UNIT_UV[i*2+1];
+            }
+        }
+        
+        mappedTexture = currentTexture();
+        dirty = true;
+    }
+    
+    // texture coordinates of the whole image, for each vertex of the quad
+    static const GLfloat UNIT_UV[6*2];
+    
     GLfloat *uv;
     float x, y, width, height;
-    STImage * image;
-    STTexture * texture;
+    const SGTextureCache::Entry * cached;
+    // the image decoded at a larger size, while it loads; NULL otherwise
+    const SGTextureCache::Entry * larger;
+    // the texture uv was last mapped for
+    STTexture *mappedTexture;
+    // the image's own copy of its pixels, once /sg/subimage has changed
+    // them; NULL until then
+    STTexture *streamTexture;
+};
+
+SGTextureCache SGImage::textures;
+bool SGImage::mipmapsByDefault = false;
+int SGImage::maxTextureSize = SGImage::MAX_PIXEL_SIZE;
+SGPixelRing *SGImage::pixelRing = NULL;
+const GLfloat SGImage::UNIT_UV[6*2] =
+{
+    0, 0,   1, 0,   0, 1,
+    1, 0,   0, 1,   1, 1,
 };
 
 
@@ -530,28 +941,7 @@ public:
         numVertex = 0;
     }
     
-    virtual void render()
-    {
-        if(numVertex == 0 || geo == NULL) return;
-        // set color
-        int location = glGetUniformLocation(program, "color");
-        glUniform4f(location, color.r, color.g, color.b, color.a);
-        location = glGetUniformLocation(program, "texOffset");
-        glUniform4f(location, 1, 1, 1, 1);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, numVertex * (sizeof(GLfloat) * 2), geo, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(VERTEX_ARRAY);
-        glVertexAttribPointer(VERTEX_ARRAY, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        
-        glActiveTexture(GL_TEXTURE0);
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        GLuint textureUniform = glGetUniformLocation(program, "tex");
-        glUniform1i(textureUniform, 0);
-        
-        glDrawArrays(GL_LINES, 0, numVertex);
-    }
+    virtual GLenum primitiveMode() { return GL_LINES; }
     
     virtual void processMessage(const SGMessage &msg)
     {
@@ -567,7 +957,7 @@ public:
                 setPosition(msg.position.x, msg.position.y);
             break;
             case SGMessage::SIZE:
-                setPosition(msg.size.x, msg.size.y);
+                setSize(msg.size.x, msg.size.y);
             break;
             default:
             break;
@@ -576,6 +966,7 @@ public:
     
     void setDimensions(float _x, float _y, float _width, float _height)
     {
+        dirty = true;
         x = _x; y = _y;
         width = _width; height = _height;
 
@@ -587,6 +978,7 @@ public:
     
     void setPosition(float _x, float _y)
     {
+        dirty = true;
         x = _x; y = _y;
 
         geo[0] = x;
@@ -597,6 +989,7 @@ public:
     
     void setSize(float _width, float _height)
     {
+        dirty = true;
         width = _width; height = _height;
 
         geo[0] = x;
@@ -611,159 +1004,740 @@ protected:
 };
 
 
-#define PORT 7000
-
-CircularBuffer<SGMessage> g_msgBuffer(50);
-GLuint g_program = 0;
-std::map<std::string, SGObject *> g_objects;
-
-
-class ExamplePacketListener : public osc::OscPacketListener
+// Draws every batchable object of a frame from one streaming vertex buffer.
+// Objects are packed in render order, and consecutive objects with the same
+// primitive mode and texture share a single glDrawArrays, so a scene of
+// untextured rectangles and ellipses is one draw call, and so is a run of
+// sprites from the same texture atlas page. An unbatchable object (e.g. an
+// image with a texture of its own) splits the batch and draws itself in
+// between, which keeps the blending order of the scene intact.
+// The packed array persists between frames. While the set of objects and
+// their vertex counts stay the same, only dirty objects are repacked and
+// re-uploaded, so a static scene uploads nothing.
+class SGBatch
 {
-protected:
-        
-    std::string GetId( const osc::ReceivedMessage& m )
+public:
+    SGBatch() : program(NULL), vbo(0), vboSize(0), enabled(true) { }
+    
+    void setShaderProgram(SGShaderProgram *p) { program = p; }
+    
+    // with batching disabled every object draws itself
+    void setEnabled(bool e) { enabled = e; }
+    
+    void render(const std::vector<SGObject *> &objects)
     {
-        std::string theId;
-        std::ostringstream ss;
-        
-        const osc::ReceivedMessageArgument &arg = *m.ArgumentsBegin();
-        if(arg.IsString())
+        if(!enabled)
         {
-            theId = arg.AsString();
+            for(size_t i = 0; i < objects.size(); i++)
+                objects[i]->render();
+            return;
         }
-        else if(arg.IsInt32())
+        
+        if(vbo == 0)
+            glGenBuffers(1, &vbo);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        
+        if(layoutChanged(objects))
+            rebuild(objects);
+        else
+            update();
+        
+        bool bound = false;
+        STTexture *texture = NULL;
+        for(size_t r = 0; r < runs.size(); r++)
         {
-            ss << arg.AsInt32();
-            theId = ss.str();
+            if(runs[r].object != NULL)
+            {
+                runs[r].object->render();
+                bound = false;
+                continue;
+            }
+            
+            if(!bound)
+            {
+                bind();
+                bound = true;
+                texture = NULL;
+            }
+            
+            if(runs[r].texture != texture)
+            {
+                texture = runs[r].texture;
+                bindTexture(texture);
+            }
+            
+            glDrawArrays(runs[r].mode, runs[r].first, runs[r].count);
         }
-        else if(arg.IsFloat())
+        
+        glDisableVertexAttribArray(COLOR_ARRAY);
+        glDisableVertexAttribArray(SHAPE_ARRAY);
+        glDisableVertexAttribArray(TEXCOORD_ARRAY);
+    }
+    
+private:
+    
+    // set up buffer, attributes and uniforms for batched drawing
+    void bind()
+    {
+        program->uniform4f(SGShaderProgram::COLOR, 1, 1, 1, 1);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(VERTEX_ARRAY);
+        glVertexAttribPointer(VERTEX_ARRAY, 2, GL_FLOAT, GL_FALSE,
+            sizeof(SGVertex), (GLvoid*) offsetof(SGVertex, x));
+        glEnableVertexAttribArray(COLOR_ARRAY);
+        glVertexAttribPointer(COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+            sizeof(SGVertex), (GLvoid*) offsetof(SGVertex, r));
+        glEnableVertexAttribArray(SHAPE_ARRAY);
+        glVertexAttribPointer(SHAPE_ARRAY, 2, GL_BYTE, GL_TRUE,
+            sizeof(SGVertex), (GLvoid*) offsetof(SGVertex, s));
+        glEnableVertexAttribArray(TEXCOORD_ARRAY);
+        glVertexAttribPointer(TEXCOORD_ARRAY, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+            sizeof(SGVertex), (GLvoid*) offsetof(SGVertex, u));
+        
+        glActiveTexture(GL_TEXTURE0);
+        bindTexture(NULL);
+        program->uniform1i(SGShaderProgram::TEX, 0);
+    }
+    
+    // draw with texture, or untextured if it is NULL
+    void bindTexture(STTexture *texture)
+    {
+        if(texture != NULL)
         {
-            ss << arg.AsFloat();
-            theId = ss.str();
+            program->uniform4f(SGShaderProgram::TEX_OFFSET, 0, 0, 0, 0);
+            texture->Bind();
         }
         else
         {
-            fprintf(stderr, "ExamplePacketListener::GetId: unable to get id");
+            program->uniform4f(SGShaderProgram::TEX_OFFSET, 1, 1, 1, 1);
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+    
+    // true if objects differ from last frame in order, primitive mode,
+    // texture or vertex count, i.e. the packed vertex array must be laid
+    // out anew
+    bool layoutChanged(const std::vector<SGObject *> &objects)
+    {
+        if(objects.size() != slots.size())
+            return true;
+        
+        for(size_t i = 0; i < objects.size(); i++)
+        {
+            SGObject *o = objects[i];
+            const Slot &slot = slots[i];
+            
+            if(o != slot.object || o->batchable() != slot.batched)
+                return true;
+            if(slot.batched && (o->vertexCount() != slot.count ||
+                                o->primitiveMode() != slot.mode ||
+                                o->batchTexture() != slot.texture))
+                return true;
         }
         
-        return theId;
+        return false;
     }
     
-    virtual void ProcessMessage( const osc::ReceivedMessage& m, 
-                                 const IpEndpointName& remoteEndpoint )
+    // pack every object, split them into runs and upload everything
+    void rebuild(const std::vector<SGObject *> &objects)
     {
-        try
+        vertices.clear();
+        runs.clear();
+        slots.resize(objects.size());
+        
+        for(size_t i = 0; i < objects.size(); i++)
         {
-            SGMessage msg;
-            msg.objectId = GetId(m);
-            osc::ReceivedMessageArgumentIterator i = ++m.ArgumentsBegin();
+            SGObject *o = objects[i];
+            Slot &slot = slots[i];
+            slot.object = o;
+            slot.batched = o->batchable();
             
-            if(strcmp( m.AddressPattern(), "/sg/line" ) == 0)
+            if(!slot.batched)
             {
-                msg.type = SGMessage::LINE;
-                msg.position.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.position.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                Run run = { 0, 0, 0, NULL, o };
+                runs.push_back(run);
+                continue;
             }
-            else if(strcmp( m.AddressPattern(), "/sg/rect" ) == 0)
+            
+            slot.mode = o->primitiveMode();
+            slot.texture = o->batchTexture();
+            slot.count = o->vertexCount();
+            slot.first = vertices.size();
+            if(slot.count == 0)
+                continue;
+            
+            if(runs.empty() || runs.back().object != NULL || runs.back().mode != slot.mode ||
+               runs.back().texture != slot.texture)
             {
-                msg.type = SGMessage::RECT;
-                msg.position.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.position.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                Run run = { slot.mode, slot.first, 0, slot.texture, NULL };
+                runs.push_back(run);
             }
-            else if(strcmp( m.AddressPattern(), "/sg/ellipse" ) == 0)
+            
+            vertices.resize(slot.first + slot.count);
+            o->appendVertices(&vertices[slot.first]);
+            o->clearDirty();
+            runs.back().count += slot.count;
+        }
+        
+        size_t bytes = vertices.size() * sizeof(SGVertex);
+        if(bytes > vboSize)
+        {
+            vboSize = bytes*2;
+            glBufferData(GL_ARRAY_BUFFER, vboSize, NULL, GL_DYNAMIC_DRAW);
+        }
+        if(bytes)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &vertices[0]);
+        SGObject::bytesUploaded += bytes;
+    }
+    
+    // repack only dirty objects, uploading each contiguous dirty range once
+    void update()
+    {
+        GLint rangeFirst = 0, rangeEnd = 0;
+        
+        for(size_t i = 0; i < slots.size(); i++)
+        {
+            const Slot &slot = slots[i];
+            if(!slot.batched || slot.count == 0 || !slot.object->isDirty())
+                continue;
+            
+            slot.object->appendVertices(&vertices[slot.first]);
+            slot.object->clearDirty();
+            
+            if(slot.first != rangeEnd)
             {
-                msg.type = SGMessage::ELLIPSE;
-                msg.position.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.position.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                uploadRange(rangeFirst, rangeEnd);
+                rangeFirst = slot.first;
             }
-            else if(strcmp( m.AddressPattern(), "/sg/image" ) == 0)
-            {
-                msg.type = SGMessage::IMAGE;
-                msg.str = (i++)->AsString();
-                msg.position.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.position.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
-            }
-            else if(strcmp( m.AddressPattern(), "/sg/remove" ) == 0)
-            {
-                msg.type = SGMessage::REMOVE;
-                g_msgBuffer.put(msg);
-            }
-            else if(strcmp( m.AddressPattern(), "/sg/position" ) == 0)
-            {
-                msg.type = SGMessage::POSITION;
-                msg.position.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.position.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
-            }
-            else if(strcmp( m.AddressPattern(), "/sg/size" ) == 0)
-            {
-                msg.type = SGMessage::SIZE;
-                msg.size.x = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.size.y = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
-            }
-            else if(strcmp( m.AddressPattern(), "/sg/color" ) == 0)
+            rangeEnd = slot.first + slot.count;
+        }
+        
+        uploadRange(rangeFirst, rangeEnd);
+    }
+    
+    void uploadRange(GLint first, GLint end)
+    {
+        if(end <= first)
+            return;
+        
+        size_t bytes = (end - first) * sizeof(SGVertex);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(SGVertex), bytes,
+            &vertices[first]);
+        SGObject::bytesUploaded += bytes;
+    }
+    
+    // a range of batched vertices, or an unbatchable object
+    struct Run
+    {
+        GLenum mode;
+        GLint first;
+        GLsizei count;
+        STTexture *texture;
+        SGObject *object;
+    };
+    
+    // where an object's vertices went in the last rebuild
+    struct Slot
+    {
+        SGObject *object;
+        bool batched;
+        GLenum mode;
+        STTexture *texture;
+        GLint first;
+        GLsizei count;
+    };
+    
+    SGShaderProgram *program;
+    GLuint vbo;
+    size_t vboSize;
+    bool enabled;
+    std::vector<SGVertex> vertices;
+    std::vector<Run> runs;
+    std::vector<Slot> slots;
+};
+
+
+// All live objects. Objects are found by the handle their id was interned
+// to on the OSC thread, and rendered in id order (the order the old
+// std::map<std::string, SGObject *> store gave) from a dense array that is
+// only re-sorted on frames where objects were added or removed.
+class SGScene
+{
+public:
+    SGScene() : m_numSorted(0), m_orderDirty(false) { }
+    
+    ~SGScene()
+    {
+        for(size_t i = 0; i < m_objects.size(); i++)
+            delete m_objects[i];
+    }
+    
+    // object for handle, or NULL if there is none
+    SGObject *get(unsigned handle)
+    {
+        return handle < m_byHandle.size() ? m_byHandle[handle] : NULL;
+    }
+    
+    // take ownership of o as the object for handle
+    void add(unsigned handle, const std::string &id, SGObject *o)
+    {
+        if(handle >= m_byHandle.size())
+        {
+            m_byHandle.resize(handle+1, NULL);
+            m_denseIndex.resize(handle+1, 0);
+        }
+        
+        o->setId(id, handle);
+        m_byHandle[handle] = o;
+        m_denseIndex[handle] = m_objects.size();
+        m_objects.push_back(o);
+        m_orderDirty = true;
+    }
+    
+    // delete the object for handle, if any
+    void remove(unsigned handle)
+    {
+        SGObject *o = get(handle);
+        if(o == NULL)
+            return;
+        
+        m_objects[m_denseIndex[handle]] = NULL;
+        m_byHandle[handle] = NULL;
+        m_orderDirty = true;
+        delete o;
+    }
+    
+    void render(SGBatch &batch)
+    {
+        if(m_orderDirty)
+            sortObjects();
+        
+        batch.render(m_objects);
+    }
+    
+    // append the objects whose ids match an OSC pattern to matches
+    // only the ids starting with one of the pattern's literal prefixes are
+    // tested, found by binary search of the id-sorted objects
+    void match(const char *pattern, std::vector<SGObject *> &matches)
+    {
+        if(m_orderDirty)
+            sortObjects();
+        
+        SGPattern::prefixes(pattern, m_prefixes);
+        for(size_t p = 0; p < m_prefixes.size(); p++)
+        {
+            const std::string &prefix = m_prefixes[p];
+            std::vector<SGObject *>::iterator o = std::lower_bound(
+                m_objects.begin(), m_objects.end(), prefix, idLessThan);
+            for(; o != m_objects.end() &&
+                (*o)->id().compare(0, prefix.size(), prefix) == 0; o++)
             {
-                msg.type = SGMessage::COLOR;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                if(SGPattern::match(pattern, (*o)->id().c_str()))
+                    matches.push_back(*o);
             }
-            else if(strcmp( m.AddressPattern(), "/sg/red" ) == 0)
+        }
+    }
+    
+    size_t size() const { return m_objects.size(); }
+    
+private:
+    
+    static bool idLess(SGObject *a, SGObject *b) { return a->id() < b->id(); }
+    static bool idLessThan(SGObject *a, const std::string &id) { return a->id() < id; }
+    
+    // compact out removed objects and restore id order: only the objects
+    // added since the last time are sorted, then merged into the rest
+    void sortObjects()
+    {
+        size_t numSorted = m_numSorted - std::count(m_objects.begin(),
+            m_objects.begin() + m_numSorted, (SGObject *) NULL);
+        m_objects.erase(std::remove(m_objects.begin(), m_objects.end(),
+            (SGObject *) NULL), m_objects.end());
+        
+        std::sort(m_objects.begin() + numSorted, m_objects.end(), idLess);
+        std::inplace_merge(m_objects.begin(), m_objects.begin() + numSorted,
+            m_objects.end(), idLess);
+        
+        for(size_t i = 0; i < m_objects.size(); i++)
+            m_denseIndex[m_objects[i]->handle()] = i;
+        
+        m_numSorted = m_objects.size();
+        m_orderDirty = false;
+    }
+    
+    // indexed by handle
+    std::vector<SGObject *> m_byHandle;
+    std::vector<size_t> m_denseIndex;
+    // render order
+    std::vector<SGObject *> m_objects;
+    // how many of m_objects, from the front, are in id order (the rest
+    // were added since the last sortObjects())
+    size_t m_numSorted;
+    bool m_orderDirty;
+    // scratch for match()
+    std::vector<std::string> m_prefixes;
+};
+
+
+#define PORT 7000
+// default ingest queue capacity, override with -q
+#define DEFAULT_QUEUE_SIZE 1024
+// largest -q accepted, in messages
+#define MAX_QUEUE_SIZE (1024*1024)
+// background threads decoding image files
+#define IMAGE_DECODE_THREADS 2
+// max bytes of decoded images uploaded to GL per frame
+#define TEXTURE_UPLOAD_BUDGET (4*1024*1024)
+// bytes of streamed pixels in flight between the OSC and render threads
+#define DEFAULT_PIXEL_RING_SIZE (16*1024*1024)
+// largest -r accepted, in megabytes
+#define MAX_PIXEL_RING_MEGABYTES 1024
+// largest -l accepted, in milliseconds
+#define MAX_BUNDLE_LATENCY_MS 60000
+
+SGMessageQueue * g_msgQueue = NULL;
+SGShaderProgram g_shader;
+SGScene g_scene;
+SGBatch g_batch;
+
+
+class ExamplePacketListener : public osc::OscPacketListener
+{
+protected:
+    
+    // check that a blob holds the pixels of msg's rectangle in format
+    // ("rgba", "rgb" or "gray"), then convert them to RGBA straight from
+    // the packet into the pixel ring
+    // returns false if the message has to be dropped
+    bool StagePixels( SGMessage &msg, const char *format,
+        const osc::ReceivedMessageArgument &blob )
+    {
+        const void *data;
+        unsigned long dataSize;
+        blob.AsBlob(data, dataSize);
+        
+        int bytesPerPixel = 0;
+        if(strcmp(format, "rgba") == 0)
+            bytesPerPixel = 4;
+        else if(strcmp(format, "rgb") == 0)
+            bytesPerPixel = 3;
+        else if(strcmp(format, "gray") == 0)
+            bytesPerPixel = 1;
+        
+        // the rectangle has to fit in a texture; NaN fails every test
+        float limit = SGImage::maxTextureSize;
+        if(!(msg.position.x >= 0 && msg.position.x + msg.size.x <= limit &&
+             msg.position.y >= 0 && msg.position.y + msg.size.y <= limit &&
+             msg.size.x >= 1 && msg.size.y >= 1))
+        {
+            std::cout << "error: " << msg.size.x << "x" << msg.size.y
+                << " pixels at " << msg.position.x << ", " << msg.position.y
+                << " don't fit in a " << SGImage::maxTextureSize << " pixel texture\n";
+            return false;
+        }
+        
+        int width = (int) msg.size.x, height = (int) msg.size.y;
+        size_t numPixels = (size_t) width * height;
+        if(bytesPerPixel == 0 ||
+           dataSize != numPixels * bytesPerPixel ||
+           numPixels * 4 > SGImage::pixelRing->size())
+        {
+            std::cout << "error: expected " << width << "x" << height
+                << " " << format << " pixels, got " << dataSize << " bytes\n";
+            return false;
+        }
+        
+        // the render thread is behind: drop the frame rather than wait
+        unsigned char *out = SGImage::pixelRing->reserve(numPixels * 4,
+            msg.pixels);
+        if(out == NULL)
+        {
+            SGImage::pixelRing->countDropped();
+            return false;
+        }
+        
+        if(bytesPerPixel == 4)
+            memcpy(out, data, numPixels * 4);
+        else if(bytesPerPixel == 3)
+            STConvertRGBToRGBA((const unsigned char *) data,
+                (STColor4ub *) out, (int) numPixels);
+        else
+            STConvertGrayToRGBA((const unsigned char *) data,
+                (STColor4ub *) out, (int) numPixels);
+        
+        SGImage::pixelRing->commit(msg.pixels, numPixels * 4);
+        return true;
+    }
+        
+    // the id of a message as a string: pointing into the packet for string
+    // ids, or formatted into buf (of ID_BUFFER_SIZE bytes) for numbers
+    enum { ID_BUFFER_SIZE = 32 };
+    const char *GetId( const osc::ReceivedMessage& m, char *buf )
+    {
+        // keep the iterator: the argument it yields lives inside it
+        osc::ReceivedMessageArgumentIterator first = m.ArgumentsBegin();
+        const osc::ReceivedMessageArgument &arg = *first;
+        if(arg.IsString())
+            return arg.AsString();
+        
+        if(arg.IsInt32())
+            snprintf(buf, ID_BUFFER_SIZE, "%d", (int) arg.AsInt32());
+        else if(arg.IsFloat())
+            snprintf(buf, ID_BUFFER_SIZE, "%g", arg.AsFloat());
+        else
+        {
+            fprintf(stderr, "ExamplePacketListener::GetId: unable to get id");
+            buf[0] = '\0';
+        }
+        
+        return buf;
+    }
+    
+    // read the width and height of a /sg/pixels frame into msg
+    // returns false if no texture can be that big
+    static bool NextFrameSize( osc::ReceivedMessageArgumentIterator &i,
+        SGMessage &msg )
+    {
+        float width = NextFloat(i), height = NextFloat(i);
+        float limit = SGImage::maxTextureSize;
+        if(!(width >= 1 && width <= limit && height >= 1 && height <= limit))
+        {
+            std::cout << "error: " << width << "x" << height << " frame is not "
+                "between 1x1 and " << limit << "x" << limit << " pixels\n";
+            return false;
+        }
+        
+        msg.frameWidth = (int) width;
+        msg.frameHeight = (int) height;
+        return true;
+    }
+    
+    // the next argument as a float, whether it was sent as an int or a float
+    static float NextFloat( osc::ReceivedMessageArgumentIterator &i )
+    {
+        float f = i->IsInt32() ? i->AsInt32() : i->AsFloat();
+        i++;
+        return f;
+    }
+    
+    // a decoder fills in msg from the arguments after the id, and returns
+    // false if the message should be dropped instead of queued
+    typedef bool (ExamplePacketListener::*Decoder)( const osc::ReceivedMessage &m,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg );
+    
+    // what an address does: the type of message it makes, and how its
+    // arguments are decoded into it
+    struct Command
+    {
+        SGMessage::Type type;
+        Decoder decode;
+    };
+    
+    struct Address
+    {
+        const char *pattern;
+        Command command;
+    };
+    
+    static const Address ADDRESSES[];
+    
+    // /sg/line, /sg/rect, /sg/ellipse <id> <x> <y> <width> <height> <r> <g> <b> <a>
+    bool DecodeShape( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.position.x = NextFloat(i);
+        msg.position.y = NextFloat(i);
+        msg.size.x = NextFloat(i);
+        msg.size.y = NextFloat(i);
+        msg.color.r = NextFloat(i);
+        msg.color.g = NextFloat(i);
+        msg.color.b = NextFloat(i);
+        msg.color.a = NextFloat(i);
+        return true;
+    }
+    
+    // /sg/image <id> <path> <x> <y> <width> <height> <r> <g> <b> <a> [mipmaps]
+    bool DecodeImage( const osc::ReceivedMessage &m,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.str = m_paths.name(m_paths.intern((i++)->AsString()));
+        DecodeShape(m, i, msg);
+        // optional: 1 to mipmap the image, 0 not to
+        msg.mipmaps = -1;
+        if(i != m.ArgumentsEnd())
+            msg.mipmaps = NextFloat(i) != 0;
+        return true;
+    }
+    
+    // /sg/subimage <id> <x> <y> <width> <height> <blob>
+    // replaces a rectangle of an image with width*height RGBA pixels, bottom
+    // row first; x, y are in pixels from the bottom-left corner of the image.
+    // Images the GL holds ETC1 compressed (.pkm files) can't be updated.
+    bool DecodeSubimage( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.position.x = NextFloat(i);
+        msg.position.y = NextFloat(i);
+        msg.size.x = NextFloat(i);
+        msg.size.y = NextFloat(i);
+        msg.frameWidth = msg.frameHeight = 0;
+        return StagePixels(msg, "rgba", *i);
+    }
+    
+    // /sg/pixels <id> <width> <height> <format> <blob>
+    // replaces all of an image with a width x height frame, bottom row
+    // first; format is rgba, rgb or gray
+    bool DecodePixels( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        if(!NextFrameSize(i, msg))
+            return false;
+        const char *format = (i++)->AsString();
+        msg.position.x = msg.position.y = 0;
+        msg.size.x = msg.frameWidth;
+        msg.size.y = msg.frameHeight;
+        return StagePixels(msg, format, *i);
+    }
+    
+    // /sg/pixels/tile <id> <width> <height> <format>
+    //     <x> <y> <tile width> <tile height> <blob>
+    // one tile of a frame too large for a single datagram; tiles are shown
+    // as they arrive
+    bool DecodePixelsTile( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        if(!NextFrameSize(i, msg))
+            return false;
+        const char *format = (i++)->AsString();
+        msg.position.x = NextFloat(i);
+        msg.position.y = NextFloat(i);
+        msg.size.x = NextFloat(i);
+        msg.size.y = NextFloat(i);
+        if(!(msg.position.x >= 0 && msg.position.y >= 0 &&
+             msg.position.x + msg.size.x <= msg.frameWidth &&
+             msg.position.y + msg.size.y <= msg.frameHeight))
+        {
+            std::cout << "error: tile outside its "
+                << msg.frameWidth << "x" << msg.frameHeight << " frame\n";
+            return false;
+        }
+        return StagePixels(msg, format, *i);
+    }
+    
+    // /sg/remove <id>
+    bool DecodeRemove( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator & /* i */, SGMessage & /* msg */ )
+    {
+        return true;
+    }
+    
+    // /sg/position <id> <x> <y>
+    bool DecodePosition( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.position.x = NextFloat(i);
+        msg.position.y = NextFloat(i);
+        return true;
+    }
+    
+    // /sg/size <id> <width> <height>
+    bool DecodeSize( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.size.x = NextFloat(i);
+        msg.size.y = NextFloat(i);
+        return true;
+    }
+    
+    // /sg/color <id> <r> <g> <b> <a>
+    bool DecodeColor( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        msg.color.r = NextFloat(i);
+        msg.color.g = NextFloat(i);
+        msg.color.b = NextFloat(i);
+        msg.color.a = NextFloat(i);
+        return true;
+    }
+    
+    // /sg/red, /sg/green, /sg/blue, /sg/alpha <id> <value>
+    bool DecodeChannel( const osc::ReceivedMessage & /* m */,
+        osc::ReceivedMessageArgumentIterator &i, SGMessage &msg )
+    {
+        float value = NextFloat(i);
+        switch(msg.type)
+        {
+            case SGMessage::RED: msg.color.r = value; break;
+            case SGMessage::GREEN: msg.color.g = value; break;
+            case SGMessage::BLUE: msg.color.b = value; break;
+            default: msg.color.a = value; break;
+        }
+        return true;
+    }
+    
+    // object ids, id patterns and image files seen so far (only touched on
+    // this thread)
+    SGIdTable m_ids;
+    SGIdTable m_patterns;
+    SGIdTable m_paths;
+    // ADDRESSES, hashed
+    SGOscDispatcher<Command> m_commands;
+    // time tag of the bundle being processed, if any
+    SGScheduler::TimeTag m_timeTag;
+    
+    virtual void ProcessBundle( const osc::ReceivedBundle& b,
+                                const IpEndpointName& remoteEndpoint )
+    {
+        // nested bundles have their own time tags (no earlier than ours)
+        SGScheduler::TimeTag outer = m_timeTag;
+        m_timeTag = b.TimeTag();
+        osc::OscPacketListener::ProcessBundle(b, remoteEndpoint);
+        m_timeTag = outer;
+    }
+    
+    virtual void ProcessMessage( const osc::ReceivedMessage& m, 
+                                 const IpEndpointName& remoteEndpoint )
+    {
+        const Command *command = m_commands.find(m.AddressPattern());
+        if(command == NULL)
+            return;
+        
+        try
+        {
+            SGMessage msg = SGMessage();
+            msg.type = command->type;
+            msg.timeTag = m_timeTag;
+            char idBuffer[ID_BUFFER_SIZE];
+            const char *id = GetId(m, idBuffer);
+            if(!SGPattern::isPattern(id))
             {
-                msg.type = SGMessage::RED;
-                msg.color.r = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                msg.handle = m_ids.intern(id);
+                msg.objectId = m_ids.name(msg.handle);
             }
-            else if(strcmp( m.AddressPattern(), "/sg/green" ) == 0)
+            else if(SGPattern::numExpansions(id) > SGPattern::MAX_EXPANSIONS)
             {
-                msg.type = SGMessage::GREEN;
-                msg.color.g = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                std::cout << "error: " << m.AddressPattern()
+                    << ": pattern has too many {..} alternatives: " << id << "\n";
+                return;
             }
-            else if(strcmp( m.AddressPattern(), "/sg/blue" ) == 0)
+            else if(msg.isPropertyUpdate() || msg.type == SGMessage::REMOVE)
             {
-                msg.type = SGMessage::BLUE;
-                msg.color.b = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                msg.handle = SGMessage::PATTERN_HANDLE;
+                msg.objectId = m_patterns.name(m_patterns.intern(id));
             }
-            else if(strcmp( m.AddressPattern(), "/sg/alpha" ) == 0)
+            else
             {
-                msg.type = SGMessage::ALPHA;
-                msg.color.a = i->IsInt32() ? i->AsInt32() : i->AsFloat(); i++;
-                g_msgBuffer.put(msg);
+                std::cout << "error: " << m.AddressPattern()
+                    << ": object id can't be a pattern: " << id << "\n";
+                return;
             }
+            osc::ReceivedMessageArgumentIterator i = ++m.ArgumentsBegin();
+            
+            if((this->*command->decode)(m, i, msg))
+                g_msgQueue->put(msg);
         }
         catch( osc::Exception& e )
         {
@@ -773,20 +1747,81 @@ protected:
                 << m.AddressPattern() << ": " << e.what() << "\n";
         }
     }
+    
+public:
+    
+    ExamplePacketListener() : m_timeTag(SGScheduler::IMMEDIATELY)
+    {
+        for(const Address *a = ADDRESSES; a->pattern != NULL; a++)
+            m_commands.add(a->pattern, a->command);
+    }
+    
+    virtual void ProcessPacket( const char *data, int size,
+                                const IpEndpointName& remoteEndpoint )
+    {
+        // a bundle, with any bundles nested in it, reaches the render
+        // thread as one transaction
+        g_msgQueue->begin();
+        try
+        {
+            osc::OscPacketListener::ProcessPacket(data, size, remoteEndpoint);
+        }
+        catch( osc::Exception& e )
+        {
+            // a malformed bundle: drop all of it, since the render thread
+            // must only ever see whole bundles
+            std::cout << "error while parsing packet: " << e.what() << "\n";
+            m_timeTag = SGScheduler::IMMEDIATELY;
+            g_msgQueue->abort(SGImage::pixelRing);
+            return;
+        }
+        g_msgQueue->commit();
+    }
+};
+
+const ExamplePacketListener::Address ExamplePacketListener::ADDRESSES[] =
+{
+    { "/sg/line", { SGMessage::LINE, &ExamplePacketListener::DecodeShape } },
+    { "/sg/rect", { SGMessage::RECT, &ExamplePacketListener::DecodeShape } },
+    { "/sg/ellipse", { SGMessage::ELLIPSE, &ExamplePacketListener::DecodeShape } },
+    { "/sg/image", { SGMessage::IMAGE, &ExamplePacketListener::DecodeImage } },
+    { "/sg/subimage", { SGMessage::SUBIMAGE, &ExamplePacketListener::DecodeSubimage } },
+    { "/sg/pixels", { SGMessage::SUBIMAGE, &ExamplePacketListener::DecodePixels } },
+    { "/sg/pixels/tile", { SGMessage::SUBIMAGE, &ExamplePacketListener::DecodePixelsTile } },
+    { "/sg/remove", { SGMessage::REMOVE, &ExamplePacketListener::DecodeRemove } },
+    { "/sg/position", { SGMessage::POSITION, &ExamplePacketListener::DecodePosition } },
+    { "/sg/size", { SGMessage::SIZE, &ExamplePacketListener::DecodeSize } },
+    { "/sg/color", { SGMessage::COLOR, &ExamplePacketListener::DecodeColor } },
+    { "/sg/red", { SGMessage::RED, &ExamplePacketListener::DecodeChannel } },
+    { "/sg/green", { SGMessage::GREEN, &ExamplePacketListener::DecodeChannel } },
+    { "/sg/blue", { SGMessage::BLUE, &ExamplePacketListener::DecodeChannel } },
+    { "/sg/alpha", { SGMessage::ALPHA, &ExamplePacketListener::DecodeChannel } },
+    { NULL, { SGMessage::REMOVE, NULL } },
 };
 
 ExamplePacketListener listener;
-UdpListeningReceiveSocket receiver(IpEndpointName( IpEndpointName::ANY_ADDRESS, PORT ), &listener );
+
+// SG_NO_MAIN leaves out the program around the scene code (the socket, the
+// OSC thread and main()), for bench/bench_batch to drive the scene itself
+#ifndef SG_NO_MAIN
+
+UdpReceiveSocket receiveSocket(IpEndpointName( IpEndpointName::ANY_ADDRESS, PORT ));
+SocketReceiveMultiplexer receiver;
 
 // Edgar:  We need a function like this for the thread to run at its creation time.
 // Arguments could be passed via (void *)ptr -- in this case the argument is a 
 // string that is printed to indicate that the thread has started successfully.
 void *pthread_start_function( void *ptr )
 {
+     receiver.AttachSocketListener( &receiveSocket, &listener );
+     // keep messages stuck in the queue's overflow list moving
+     receiver.AttachPeriodicTimerListener( 5, g_msgQueue );
      receiver.RunUntilSigInt();
      return NULL;
 }
 
+#endif // SG_NO_MAIN
+
 
 /******************************************************************************
  Now back to the OpenGLES code ...   First we have Defines
@@ -837,6 +1872,139 @@ void additiveBlend()
 }
 
 
+// apply a message addressed by pattern to every object it matches
+// (render thread only)
+void handlePatternMessage(const SGMessage &msg)
+{
+    static std::vector<SGObject *> matches;
+    matches.clear();
+    g_scene.match(msg.objectId, matches);
+    
+    for(size_t m = 0; m < matches.size(); m++)
+    {
+        if(msg.type == SGMessage::REMOVE)
+            g_scene.remove(matches[m]->handle());
+        else
+            matches[m]->processMessage(msg);
+    }
+}
+
+
+// apply one message from the OSC thread to the scene (render thread only)
+void handleMessage(const SGMessage &msg)
+{
+    if(msg.isPattern())
+    {
+        handlePatternMessage(msg);
+        return;
+    }
+    
+    switch(msg.type)
+    {
+        case SGMessage::RECT:
+        {
+            SGObject * r = g_scene.get(msg.handle);
+            if(r == NULL)
+            {
+                r = new SGRectangle(msg.position.x, msg.position.y,
+                    msg.size.x, msg.size.y);
+                r->setShaderProgram(&g_shader);
+                g_scene.add(msg.handle, msg.objectId, r);
+            }
+            
+            r->processMessage(msg);
+        }
+        
+        break;
+        
+        case SGMessage::IMAGE:
+        {
+            SGObject * i = g_scene.get(msg.handle);
+            if(i == NULL)
+            {
+                i = new SGImage(msg.str, msg.position.x, msg.position.y,
+                    msg.size.x, msg.size.y, msg.mipmaps < 0 ?
+                    SGImage::mipmapsByDefault : msg.mipmaps != 0);
+                i->setShaderProgram(&g_shader);
+                g_scene.add(msg.handle, msg.objectId, i);
+            }
+            
+            i->processMessage(msg);
+        }
+        
+        break;
+        
+        case SGMessage::LINE:
+        {
+            SGObject * e = g_scene.get(msg.handle);
+            if(e == NULL)
+            {
+                e = new SGLine(msg.position.x, msg.position.y,
+                    msg.size.x, msg.size.y);
+                e->setShaderProgram(&g_shader);
+                g_scene.add(msg.handle, msg.objectId, e);
+            }
+            
+            e->processMessage(msg);
+        }
+        break;
+        
+        case SGMessage::ELLIPSE:
+        {
+            SGObject * e = g_scene.get(msg.handle);
+            if(e == NULL)
+            {
+                e = new SGEllipse(msg.position.x, msg.position.y,
+                    msg.size.x, msg.size.y);
+                e->setShaderProgram(&g_shader);
+                g_scene.add(msg.handle, msg.objectId, e);
+            }
+            
+            e->processMessage(msg);
+        }
+        break;
+        
+        case SGMessage::REMOVE:
+        {
+            g_scene.remove(msg.handle);
+        }
+        break;
+        
+        default:
+        {
+            SGObject * o = g_scene.get(msg.handle);
+            if(o != NULL)
+                o->processMessage(msg);
+        }
+        break;
+    }
+}
+
+
+// parse a command line count between min and max into value
+// returns false, leaving value alone, if arg is anything else
+static bool parseCount(const char *arg, unsigned long min, unsigned long max,
+    size_t &value)
+{
+    // strtoul would quietly negate a leading '-'
+    while(isspace((unsigned char) *arg))
+        arg++;
+    if(!isdigit((unsigned char) *arg))
+        return false;
+    
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(arg, &end, 10);
+    if(*end != '\0' || errno == ERANGE || n < min || n > max)
+        return false;
+    
+    value = n;
+    return true;
+}
+
+
+#ifndef SG_NO_MAIN
+
 /*!****************************************************************************
  @Function      main
  @Input         argc        Number of arguments
@@ -846,16 +2014,84 @@ void additiveBlend()
 ******************************************************************************/
 int main(int argc, char **argv)
 {
-    if(argc == 3)
+    // usage: SimpleGraphics [width height] [-q queue_size]
+    //     [-p grow|drop-oldest|drop-newest|coalesce] [-v] [-u] [-t] [-m]
+    //     [-r pixel_ring_megabytes] [-l bundle_latency_ms]
+    // queue_size is at most MAX_QUEUE_SIZE, pixel_ring_megabytes at most
+    // MAX_PIXEL_RING_MEGABYTES, bundle_latency_ms at most
+    // MAX_BUNDLE_LATENCY_MS
+    size_t queueSize = DEFAULT_QUEUE_SIZE;
+    size_t pixelRingSize = DEFAULT_PIXEL_RING_SIZE;
+    SGMessageQueue::OverflowPolicy policy = SGMessageQueue::GROW;
+    size_t bundleLatency = 0;
+    bool verbose = false;
+    bool batching = true;
+    std::vector<const char *> sizeArgs;
+    
+    for(int a = 1; a < argc; a++)
     {
-        WINDOW_WIDTH = atoi(argv[1]);
-        WINDOW_HEIGHT = atoi(argv[2]);
+        if(strcmp(argv[a], "-q") == 0 && a+1 < argc)
+        {
+            if(!parseCount(argv[++a], 1, MAX_QUEUE_SIZE, queueSize))
+                fprintf(stderr, "SimpleGraphics: queue size '%s' is not between 1 and %d\n",
+                    argv[a], MAX_QUEUE_SIZE);
+        }
+        else if(strcmp(argv[a], "-p") == 0 && a+1 < argc)
+        {
+            if(!SGMessageQueue::policyFromString(argv[++a], policy))
+                fprintf(stderr, "SimpleGraphics: unknown queue policy '%s'\n", argv[a]);
+        }
+        else if(strcmp(argv[a], "-v") == 0)
+            verbose = true;
+        else if(strcmp(argv[a], "-u") == 0)
+            batching = false; // draw every object separately
+        else if(strcmp(argv[a], "-t") == 0)
+            SGEllipse::tessellated = true; // tessellate ellipses on the CPU
+        else if(strcmp(argv[a], "-m") == 0)
+            SGImage::mipmapsByDefault = true; // mipmap images by default
+        else if(strcmp(argv[a], "-r") == 0 && a+1 < argc)
+        {
+            size_t megabytes;
+            if(parseCount(argv[++a], 1, MAX_PIXEL_RING_MEGABYTES, megabytes))
+                pixelRingSize = megabytes * 1024 * 1024;
+            else
+                fprintf(stderr, "SimpleGraphics: pixel ring size '%s' is not between 1 and %d MB\n",
+                    argv[a], MAX_PIXEL_RING_MEGABYTES);
+        }
+        else if(strcmp(argv[a], "-l") == 0 && a+1 < argc)
+        {
+            if(!parseCount(argv[++a], 0, MAX_BUNDLE_LATENCY_MS, bundleLatency))
+                fprintf(stderr, "SimpleGraphics: bundle latency '%s' is not between 0 and %d ms\n",
+                    argv[a], MAX_BUNDLE_LATENCY_MS);
+        }
+        else
+            sizeArgs.push_back(argv[a]);
     }
     
+    if(sizeArgs.size() == 2)
+    {
+        WINDOW_WIDTH = atoi(sizeArgs[0]);
+        WINDOW_HEIGHT = atoi(sizeArgs[1]);
+    }
+    
+    g_msgQueue = new SGMessageQueue(queueSize, policy);
+    
+    SGImage::pixelRing = new SGPixelRing(pixelRingSize);
+    
     pthread_t threadHandlesOSC;
-    pthread_create( &threadHandlesOSC, NULL, pthread_start_function, NULL);
     
-    SGMessage msg;
+    // never empty, so &frameMsgs[0] is always valid
+    std::vector<SGMessage> frameMsgs(1), newMsgs;
+    std::vector<bool> skipMsgs;
+    SGCoalescer coalescer;
+    SGScheduler scheduler;
+    if(bundleLatency > 0)
+        scheduler.setLatency((unsigned) bundleLatency);
+    // SGPixelRing position just past the last streamed pixels received
+    size_t pixelsReceived = 0;
+    unsigned long frameCount = 0;
+    // bundles applied on the last frame
+    size_t numBundles = 0;
     SGObject::SCREEN_WIDTH = WINDOW_WIDTH;
     SGObject::SCREEN_HEIGHT = WINDOW_HEIGHT;
     
@@ -913,23 +2149,6 @@ int main(int argc, char **argv)
         0.0f,0.0f,0.0f,1.0f
     };
 
-    // Fragment and vertex shaders code
-    const char* pszFragShader;
-    std::ifstream inFrag("rect.fsh");
-    std::stringstream ssFrag;
-    ssFrag << inFrag.rdbuf();
-    std::string strFrag = ssFrag.str();
-    pszFragShader = strFrag.c_str();
-
-
-    const char* pszVertShader;
-    std::ifstream inVert("rect.vsh");
-    std::stringstream ssVert;
-    ssVert << inVert.rdbuf();
-    std::string strVert = ssVert.str();
-    pszVertShader = strVert.c_str();
-    
-
     /*
         Step 1 - Get the default display.
         EGL uses the concept of a "display" which in most environments
@@ -1093,205 +2312,76 @@ int main(int argc, char **argv)
         OpenGL ES to draw something on the screen.
     */
 
-    GLuint uiFragShader, uiVertShader;      // Used to hold the fragment and vertex shader handles
-    GLuint uiProgramObject;             // Used to hold the program handle (made out of the two previous shaders
-
-    // Create the fragment shader object
-    uiFragShader = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Load the source code into it
-    glShaderSource(uiFragShader, 1, (const char**)&pszFragShader, NULL);
-
-    // Compile the source code
-    glCompileShader(uiFragShader);
-
-    // Check if compilation succeeded
-    GLint bShaderCompiled;
-    glGetShaderiv(uiFragShader, GL_COMPILE_STATUS, &bShaderCompiled);
-
-    if (!bShaderCompiled)
-    {
-        // An error happened, first retrieve the length of the log message
-        int i32InfoLogLength, i32CharsWritten;
-        glGetShaderiv(uiFragShader, GL_INFO_LOG_LENGTH, &i32InfoLogLength);
-
-        // Allocate enough space for the message and retrieve it
-        char* pszInfoLog = new char[i32InfoLogLength];
-        glGetShaderInfoLog(uiFragShader, i32InfoLogLength, &i32CharsWritten, pszInfoLog);
-
-        // Displays the error
-        printf("Failed to compile fragment shader: %s\n", pszInfoLog);
-        delete [] pszInfoLog;
-        goto cleanup;
-    }
-
-    // Loads the vertex shader in the same way
-    uiVertShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(uiVertShader, 1, (const char**)&pszVertShader, NULL);
-    glCompileShader(uiVertShader);
-    glGetShaderiv(uiVertShader, GL_COMPILE_STATUS, &bShaderCompiled);
-
-    if (!bShaderCompiled)
-    {
-        int i32InfoLogLength, i32CharsWritten;
-        glGetShaderiv(uiVertShader, GL_INFO_LOG_LENGTH, &i32InfoLogLength);
-        char* pszInfoLog = new char[i32InfoLogLength];
-        glGetShaderInfoLog(uiVertShader, i32InfoLogLength, &i32CharsWritten, pszInfoLog);
-        printf("Failed to compile vertex shader: %s\n", pszInfoLog);
-        delete [] pszInfoLog;
-        goto cleanup;
-    }
-
-    // Create the shader program
-    uiProgramObject = glCreateProgram();
-
-    // Attach the fragment and vertex shaders to it
-    glAttachShader(uiProgramObject, uiFragShader);
-    glAttachShader(uiProgramObject, uiVertShader);
-
-    // Bind the custom vertex attribute "myVertex" to location VERTEX_ARRAY
-    glBindAttribLocation(uiProgramObject, VERTEX_ARRAY, "myVertex");
-
-    // Link the program
-    glLinkProgram(uiProgramObject);
-
-    // Check if linking succeeded in the same way we checked for compilation success
-    GLint bLinked;
-    glGetProgramiv(uiProgramObject, GL_LINK_STATUS, &bLinked);
-
-    if (!bLinked)
-    {
-        int ui32InfoLogLength, ui32CharsWritten;
-        glGetProgramiv(uiProgramObject, GL_INFO_LOG_LENGTH, &ui32InfoLogLength);
-        char* pszInfoLog = new char[ui32InfoLogLength];
-        glGetProgramInfoLog(uiProgramObject, ui32InfoLogLength, &ui32CharsWritten, pszInfoLog);
-        printf("Failed to link program: %s\n", pszInfoLog);
-        delete [] pszInfoLog;
+    // Compile and link the shaders, and resolve their locations
+    if(!g_shader.load("rect.vsh", "rect.fsh"))
         goto cleanup;
-    }
 
     // Actually use the created program
-    glUseProgram(uiProgramObject);
+    g_shader.use();
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // black background
 
     normalBlend();
     
-    g_program = uiProgramObject;
+    g_batch.setShaderProgram(&g_shader);
+    g_batch.setEnabled(batching);
+    
+    SGImage::textures.startLoader(IMAGE_DECODE_THREADS);
+    
+    // the OSC thread checks streamed frames against the GL's limits, so
+    // it starts once there is a GL to ask
+    if(STTexture::MaxSize() > 0 && STTexture::MaxSize() < SGImage::maxTextureSize)
+        SGImage::maxTextureSize = STTexture::MaxSize();
+    pthread_create( &threadHandlesOSC, NULL, pthread_start_function, NULL);
     
     // **** Here we run the main graphics loop for controlling the GFX processor.  This loop
     // loop runs indefinitely until the user types Cntrl-C (or "killall" command) to stop
     // the process. ****
     while (1)
     {
-        while(g_msgBuffer.get(msg))
+        // messages from earlier bundles due by this frame come first, then
+        // every whole bundle (or lone message) the OSC thread has published
+        // since the last frame, less what is scheduled for later frames
+        SGScheduler::TimeTag frameTime = SGScheduler::now();
+        size_t numMsgs = scheduler.release(frameTime, frameMsgs);
+        size_t numNew = g_msgQueue->getTransactions(newMsgs);
+        if(frameMsgs.size() < numMsgs + numNew)
+            frameMsgs.resize(numMsgs + numNew);
+        for(size_t m = 0; m < numNew; m++)
         {
-            switch(msg.type)
-            {
-                case SGMessage::RECT:
-                {
-                    SGObject * r = NULL;
-                    if(g_objects.count(msg.objectId))
-                        r = g_objects[msg.objectId];
-                    else
-                    {
-                        r = new SGRectangle(msg.position.x, msg.position.y,
-                            msg.size.x, msg.size.y);
-                        r->setShaderProgram(uiProgramObject);
-                        g_objects[msg.objectId] = r;
-                    }
-                    
-                    r->processMessage(msg);
-                }
-                
-                break;
-                
-                case SGMessage::IMAGE:
-                {
-                    SGObject * i = NULL;
-                    if(g_objects.count(msg.objectId))
-                        i = g_objects[msg.objectId];
-                    else
-                    {
-                        i = new SGImage(msg.str, msg.position.x, msg.position.y,
-                            msg.size.x, msg.size.y);
-                        i->setShaderProgram(uiProgramObject);
-                        g_objects[msg.objectId] = i;
-                    }
-                    
-                    i->processMessage(msg);
-                }
-                
-                break;
-                
-                case SGMessage::LINE:
-                {
-                    SGObject * e = NULL;
-                    if(g_objects.count(msg.objectId))
-                        e = g_objects[msg.objectId];
-                    else
-                    {
-                        e = new SGLine(msg.position.x, msg.position.y,
-                            msg.size.x, msg.size.y);
-                        e->setShaderProgram(uiProgramObject);
-                        g_objects[msg.objectId] = e;
-                    }
-                    
-                    e->processMessage(msg);
-                }
-                break;
-                
-                case SGMessage::ELLIPSE:
-                {
-                    SGObject * e = NULL;
-                    if(g_objects.count(msg.objectId))
-                        e = g_objects[msg.objectId];
-                    else
-                    {
-                        e = new SGEllipse(msg.position.x, msg.position.y,
-                            msg.size.x, msg.size.y);
-                        e->setShaderProgram(uiProgramObject);
-                        g_objects[msg.objectId] = e;
-                    }
-                    
-                    e->processMessage(msg);
-                }
-                break;
-                
-                case SGMessage::REMOVE:
-                {
-                    if(g_objects.count(msg.objectId))
-                    {
-                        SGObject * o = g_objects[msg.objectId];
-                        delete o;
-                        g_objects.erase(msg.objectId);
-                    }
-                }
-                break;
-                
-                default:
-                    if(g_objects.count(msg.objectId))
-                    {
-                        SGObject * o = g_objects[msg.objectId];
-                        o->processMessage(msg);
-                    }
-                break;
-            }
+            if(newMsgs[m].type == SGMessage::SUBIMAGE)
+                pixelsReceived = newMsgs[m].pixelsEnd();
+            if(scheduler.arrive(newMsgs[m]))
+                frameMsgs[numMsgs++] = newMsgs[m];
         }
         
+        // fold away property updates superseded within this frame, then
+        // apply the rest in order
+        coalescer.coalesce(&frameMsgs[0], numMsgs, skipMsgs);
+        numBundles = 0;
+        for(size_t m = 0; m < numMsgs; m++)
+        {
+            if(!skipMsgs[m])
+                handleMessage(frameMsgs[m]);
+            if(frameMsgs[m].endsBundle)
+                numBundles++;
+        }
+        
+        // streamed pixels are done with once uploaded, or folded away,
+        // unless they are scheduled for a later frame
+        SGImage::pixelRing->release(scheduler.firstHeldPixels(pixelsReceived));
+        
+        // upload images finished decoding since the last frame
+        SGImage::textures.update(TEXTURE_UPLOAD_BUDGET);
+        
+        SGObject::bytesUploaded = 0;
+        
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
       
-        // First gets the location of that variable in the shader using its name
-        int i32Location = glGetUniformLocation(uiProgramObject, "myPMVMatrix");
-        
-        // Then passes the matrix to that variable
-        glUniformMatrix4fv( i32Location, 1, GL_FALSE, pfIdentity);
+        // Passes the matrix to the shader (only sent to GL when it changes)
+        g_shader.uniformMatrix4fv(SGShaderProgram::PMV_MATRIX, pfIdentity);
         
-        for(std::map<std::string,SGObject*>::iterator i = g_objects.begin();
-            i != g_objects.end(); i++)
-        {
-            i->second->render();
-        }
+        g_scene.render(g_batch);
         
         /*
           Swap Buffers.
@@ -1299,14 +2389,37 @@ int main(int argc, char **argv)
         */
         eglSwapBuffers(eglDisplay, eglSurface);
         
+        if(verbose && ++frameCount % 60 == 0)
+        {
+            fprintf(stderr, "SimpleGraphics: queue overflowed %lu, dropped %lu, coalesced %lu; "
+                "folded %lu per-frame updates; uploaded %lu bytes last frame; "
+                "textures: %lu hits, %lu misses, %lu resident bytes, %lu pending, "
+                "%lu atlas pages; %lu streamed frames dropped; "
+                "bundled messages: %lu early, %lu late, %lu scheduled; "
+                "%lu bundles applied last frame\n",
+                (unsigned long) g_msgQueue->numOverflowed(),
+                (unsigned long) g_msgQueue->numDropped(),
+                (unsigned long) g_msgQueue->numCoalesced(),
+                (unsigned long) coalescer.numFolded(),
+                (unsigned long) SGObject::bytesUploaded,
+                (unsigned long) SGImage::textures.numHits(),
+                (unsigned long) SGImage::textures.numMisses(),
+                (unsigned long) SGImage::textures.residentBytes(),
+                (unsigned long) SGImage::textures.numPending(),
+                (unsigned long) SGImage::textures.numAtlasPages(),
+                (unsigned long) SGImage::pixelRing->numDropped(),
+                (unsigned long) scheduler.numEarly(),
+                (unsigned long) scheduler.numLate(),
+                (unsigned long) scheduler.size(),
+                (unsigned long) numBundles);
+        }
+        
         //usleep((1000000/30)-10000);
         usleep((1000000/60));
     }
 
     // Frees the OpenGL handles for the program and the 2 shaders
-    glDeleteProgram(uiProgramObject);
-    glDeleteShader(uiFragShader);
-    glDeleteShader(uiVertShader);
+    g_shader.destroy();
 
     /*
         Step 10 - Terminate OpenGL ES and destroy the window (if present).
@@ -1320,6 +2433,8 @@ cleanup:
     return 0;
 }
 
+#endif // SG_NO_MAIN
+
 /******************************************************************************
  End of file (OGLES2HelloTriangle_NullWS.cpp)
 ******************************************************************************/
@@ -0,0 +1,49 @@
+/*******************************************************************************
+
+ SGBench
+
+ Notes: Timing for the benchmarks in this directory. Each benchmark is its
+ own program printing one line per measurement. sgTime() repeats a piece of
+ work until it has run for long enough to time reliably, and returns the
+ seconds one repetition takes.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_BENCH_H__
+#define __SG_BENCH_H__
+
+
+#include <stdio.h>
+#include <sys/time.h>
+
+
+// seconds since some fixed time
+static inline double sgSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// the seconds one call of work(arg) takes, over at least minSeconds
+template<typename Arg>
+double sgTime(void (*work)(Arg), Arg arg, double minSeconds = 0.5)
+{
+    // once untimed, to warm up caches and lazy initialization
+    work(arg);
+
+    size_t numRuns = 0;
+    double start = sgSeconds(), elapsed;
+    do
+    {
+        work(arg);
+        numRuns++;
+        elapsed = sgSeconds() - start;
+    } while(elapsed < minSeconds);
+
+    return elapsed / numRuns;
+}
+
+
+#endif // __SG_BENCH_H__
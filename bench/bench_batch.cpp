@@ -0,0 +1,154 @@
+// bench_batch.cpp
+//
+// Frame time of a scene of rectangles and ellipses drawn batched (the
+// default) and with every object drawn on its own (SimpleGraphics -u),
+// both standing still and with every object moving every frame. Needs
+// EGL and OpenGL ES 2, renders to an offscreen pbuffer, and has to run
+// from the top directory, where the shaders are: make bench-gl.
+//
+//   usage: bench/bench_batch [number of objects]
+
+#define SG_NO_MAIN
+#include "SimpleGraphics.cpp"
+
+#include "SGBench.h"
+
+
+static const int WIDTH = 640, HEIGHT = 480;
+
+static bool createContext()
+{
+#ifdef RASPBERRY_PI
+    bcm_host_init();
+#endif
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(!eglInitialize(display, NULL, NULL))
+        return false;
+
+    EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs;
+    if(!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) ||
+       numConfigs < 1)
+        return false;
+
+    EGLint surfaceAttribs[] = { EGL_WIDTH, WIDTH, EGL_HEIGHT, HEIGHT, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+        contextAttribs);
+
+    return eglMakeCurrent(display, surface, surface, context) &&
+        TestEGLError("createContext");
+}
+
+struct Scene
+{
+    int numObjects;
+    SGIdTable ids;
+    bool moving;
+    int frame;
+};
+
+static SGMessage makeMessage(Scene *scene, SGMessage::Type type, int i)
+{
+    char id[16];
+    snprintf(id, sizeof id, "o%d", i);
+
+    SGMessage msg = SGMessage();
+    msg.type = type;
+    msg.handle = scene->ids.intern(id);
+    msg.objectId = scene->ids.name(msg.handle);
+    msg.timeTag = SGScheduler::IMMEDIATELY;
+    return msg;
+}
+
+static void drawFrame(Scene *scene)
+{
+    if(scene->moving)
+    {
+        scene->frame++;
+        for(int i = 0; i < scene->numObjects; i++)
+        {
+            SGMessage msg = makeMessage(scene, SGMessage::POSITION, i);
+            msg.position.x = sinf(i + scene->frame * 0.01f) * 0.6f;
+            msg.position.y = cosf(i * 1.3f + scene->frame * 0.01f) * 0.4f;
+            handleMessage(msg);
+        }
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    g_scene.render(g_batch);
+    glFinish();
+}
+
+int main(int argc, char **argv)
+{
+    Scene scene;
+    scene.numObjects = argc > 1 ? atoi(argv[1]) : 1000;
+    scene.moving = false;
+    scene.frame = 0;
+
+    if(!createContext())
+    {
+        fprintf(stderr, "bench_batch: no EGL/OpenGL ES 2 context\n");
+        return 1;
+    }
+    if(!g_shader.load("rect.vsh", "rect.fsh"))
+        return 1;
+    g_shader.use();
+
+    float aspect = (float) WIDTH / HEIGHT;
+    float pmv[16] =
+    {
+        2.0f/aspect, 0, 0, 0,
+        0, 2.0f, 0, 0,
+        0, 0, 0.01f, 0,
+        0, 0, 0, 1,
+    };
+    g_shader.uniformMatrix4fv(SGShaderProgram::PMV_MATRIX, pmv);
+    normalBlend();
+    glViewport(0, 0, WIDTH, HEIGHT);
+    g_batch.setShaderProgram(&g_shader);
+    SGObject::SCREEN_WIDTH = WIDTH;
+    SGObject::SCREEN_HEIGHT = HEIGHT;
+
+    // half rectangles, half ellipses, small and translucent
+    for(int i = 0; i < scene.numObjects; i++)
+    {
+        SGMessage msg = makeMessage(&scene,
+            i % 2 ? SGMessage::ELLIPSE : SGMessage::RECT, i);
+        msg.position.x = (i % 40) / 40.0f - 0.5f;
+        msg.position.y = (i / 40 % 30) / 30.0f - 0.5f;
+        msg.size.x = msg.size.y = 0.05f;
+        msg.color.r = (i % 3) / 2.0f;
+        msg.color.g = (i % 5) / 4.0f;
+        msg.color.b = (i % 7) / 6.0f;
+        msg.color.a = 0.5f;
+        handleMessage(msg);
+    }
+
+    for(int moving = 0; moving < 2; moving++)
+    {
+        scene.moving = moving != 0;
+        for(int batched = 1; batched >= 0; batched--)
+        {
+            g_batch.setEnabled(batched != 0);
+            printf("%d objects, %s, %s: %.2f ms per frame\n", scene.numObjects,
+                moving ? "moving" : "still",
+                batched ? "batched" : "unbatched (-u)",
+                sgTime(drawFrame, &scene) * 1e3);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+// bench_dispatch.cpp
+//
+// Cost of finding what an OSC address does: SGOscDispatcher's hash lookup
+// against the strcmp chain it replaced, over ExamplePacketListener's
+// addresses, alone and together with parsing the packet.
+
+#include "SGBench.h"
+#include "SGOscDispatcher.h"
+
+#include "osc/OscReceivedElements.h"
+#include "osc/OscOutboundPacketStream.h"
+
+#include <string.h>
+#include <vector>
+
+
+static const char *ADDRESSES[] =
+{
+    "/sg/line", "/sg/rect", "/sg/ellipse", "/sg/image", "/sg/subimage",
+    "/sg/pixels", "/sg/pixels/tile", "/sg/remove", "/sg/position",
+    "/sg/size", "/sg/color", "/sg/red", "/sg/green", "/sg/blue", "/sg/alpha",
+};
+static const int NUM_ADDRESSES = sizeof(ADDRESSES) / sizeof(ADDRESSES[0]);
+
+// a property-heavy mix, as an animation sends
+static const char *MIX[] =
+{
+    "/sg/position", "/sg/alpha", "/sg/position", "/sg/color", "/sg/size",
+    "/sg/alpha", "/sg/red", "/sg/position", "/sg/rect", "/sg/unknown",
+};
+static const int NUM_MIX = sizeof(MIX) / sizeof(MIX[0]);
+static const int NUM_LOOKUPS = 100000;
+
+struct Mix
+{
+    SGOscDispatcher<int> dispatcher;
+    // the mix as received packets, and their addresses in the packets
+    std::vector<std::vector<char> > packets;
+    std::vector<const char *> addresses;
+    // the lookups' results add up here, so they can't be optimized away
+    volatile int found;
+};
+
+static int strcmpChain(const char *address)
+{
+    for(int a = 0; a < NUM_ADDRESSES; a++)
+    {
+        if(strcmp(address, ADDRESSES[a]) == 0)
+            return a;
+    }
+    return -1;
+}
+
+static void lookUpStrcmp(Mix *mix)
+{
+    for(int l = 0; l < NUM_LOOKUPS; l++)
+        mix->found += strcmpChain(mix->addresses[l % NUM_MIX]);
+}
+
+static void lookUpHash(Mix *mix)
+{
+    for(int l = 0; l < NUM_LOOKUPS; l++)
+    {
+        const int *a = mix->dispatcher.find(mix->addresses[l % NUM_MIX]);
+        mix->found += a != NULL ? *a : -1;
+    }
+}
+
+static void parseAndLookUp(Mix *mix)
+{
+    for(int l = 0; l < NUM_LOOKUPS; l++)
+    {
+        const std::vector<char> &packet = mix->packets[l % NUM_MIX];
+        osc::ReceivedPacket p(&packet[0], (int) packet.size());
+        osc::ReceivedMessage m(p);
+        const int *a = mix->dispatcher.find(m.AddressPattern());
+        mix->found += a != NULL ? *a : -1;
+    }
+}
+
+static void report(const char *name, double seconds)
+{
+    printf("%s: %.1f ns per message\n", name, seconds / NUM_LOOKUPS * 1e9);
+}
+
+int main()
+{
+    Mix mix;
+    mix.found = 0;
+    for(int a = 0; a < NUM_ADDRESSES; a++)
+        mix.dispatcher.add(ADDRESSES[a], a);
+
+    char buffer[256];
+    for(int m = 0; m < NUM_MIX; m++)
+    {
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginMessage(MIX[m]) << "object17" << 0.5f << 0.25f
+            << osc::EndMessage;
+        mix.packets.push_back(std::vector<char>(p.Data(), p.Data() + p.Size()));
+    }
+    for(int m = 0; m < NUM_MIX; m++)
+        mix.addresses.push_back(&mix.packets[m][0]);
+
+    report("strcmp chain", sgTime(lookUpStrcmp, &mix));
+    report("SGOscDispatcher", sgTime(lookUpHash, &mix));
+    report("parse + SGOscDispatcher", sgTime(parseAndLookUp, &mix));
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+// bench_png.cpp
+//
+// PNG decode throughput of STImage::LoadPNG, in megapixels and megabytes
+// of decoded RGBA per second.
+//
+//   usage: bench_png [file.png...]
+//
+// With no files, a noisy 1024x1024 RGBA test image is written and read.
+
+#include "SGBench.h"
+#include "STImage.h"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+
+static void decode(const char *filename)
+{
+    STImage image(filename);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<const char *> files(argv + 1, argv + argc);
+    if(files.empty())
+    {
+        // smooth enough to compress like a photo, noisy enough not to
+        // compress like a test card
+        STImage image(1024, 1024);
+        STImage::Pixel *pixels = image.GetPixels();
+        srand(1);
+        for(int y = 0; y < 1024; y++)
+        {
+            for(int x = 0; x < 1024; x++)
+            {
+                int noise = rand() % 16;
+                pixels[y*1024 + x] = STColor4ub(x / 4 + noise, y / 4 + noise,
+                    (x + y) / 8 + noise, 255 - noise);
+            }
+        }
+        image.Save("bench_png.png");
+        files.push_back("bench_png.png");
+    }
+
+    for(size_t f = 0; f < files.size(); f++)
+    {
+        STImage image(files[f]);
+        double pixels = (double) image.GetWidth() * image.GetHeight();
+        double seconds = sgTime(decode, files[f]);
+        printf("%s: %dx%d, %.1f ms per decode, %.1f Mpixel/s, %.1f MB/s RGBA\n",
+            files[f], image.GetWidth(), image.GetHeight(), seconds * 1e3,
+            pixels / seconds / 1e6, pixels * 4 / seconds / 1e6);
+    }
+
+    return 0;
+}
@@ -0,0 +1,516 @@
+// STCompressedImage.cpp
+#include "STCompressedImage.h"
+
+#include "STImage.h"
+#include "st.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+//
+// PKM files hold a 16 byte header:
+//
+//   "PKM "          magic
+//   "10"            version (ETC1)
+//   type            2 byte big-endian, 0 for ETC1 RGB without mipmaps
+//   extended size   width and height rounded up to whole blocks, 2 byte
+//                   big-endian each
+//   size            width and height in pixels, 2 byte big-endian each
+//
+// followed by the blocks, top row first as other tools write them. In
+// memory they are kept bottom row first, the order OpenGL expects, so
+// they are flipped on the way in and out.
+//
+static const int PKM_HEADER_SIZE = 16;
+static const int ETC1_BLOCK_SIZE = 8;
+
+static int
+PKMGet16(const unsigned char* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void
+PKMPut16(unsigned char* p, int value)
+{
+    p[0] = (value >> 8) & 0xff;
+    p[1] = value & 0xff;
+}
+
+static size_t
+ETC1DataSize(int width, int height)
+{
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * ETC1_BLOCK_SIZE;
+}
+
+//
+// The intensity modifiers of each ETC1 codeword table. A pixel index
+// (most significant bit, least significant bit) picks +a, +b, -a or -b.
+//
+static const int ETC1_MODIFIERS[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+static inline int
+ETC1Modifier(int table, int index)
+{
+    int m = ETC1_MODIFIERS[table][index & 1];
+    return (index & 2) ? -m : m;
+}
+
+static inline int
+Clamp255(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+//
+// Expand a block to 16 pixels, out[y*4 + x], where y = 0 is the first
+// row of the block in memory.
+//
+static void
+ETC1DecodeBlock(const unsigned char* block, STColor4ub* out)
+{
+    unsigned int hi = (block[0] << 24) | (block[1] << 16) |
+        (block[2] << 8) | block[3];
+    unsigned int lo = (block[4] << 24) | (block[5] << 16) |
+        (block[6] << 8) | block[7];
+
+    bool diff = (hi & 2) != 0;
+    bool flip = (hi & 1) != 0;
+
+    int base[2][3];
+    for (int c = 0; c < 3; ++c) {
+        int shift = 27 - c * 8;
+        if (diff) {
+            int c1 = (hi >> shift) & 0x1f;
+            int d = (hi >> (shift - 3)) & 0x7;
+            int c2 = c1 + ((d & 4) ? d - 8 : d);
+            base[0][c] = (c1 << 3) | (c1 >> 2);
+            base[1][c] = (c2 << 3) | (c2 >> 2);
+        }
+        else {
+            int c1 = (hi >> (shift + 1)) & 0xf;
+            int c2 = (hi >> (shift - 3)) & 0xf;
+            base[0][c] = (c1 << 4) | c1;
+            base[1][c] = (c2 << 4) | c2;
+        }
+    }
+
+    int table[2] = { (int) (hi >> 5) & 7, (int) (hi >> 2) & 7 };
+
+    for (int x = 0; x < 4; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            int i = x * 4 + y;
+            int sub = flip ? (y >= 2) : (x >= 2);
+            int index = (((lo >> (16 + i)) & 1) << 1) | ((lo >> i) & 1);
+            int m = ETC1Modifier(table[sub], index);
+
+            STColor4ub& p = out[y * 4 + x];
+            p.r = (unsigned char) Clamp255(base[sub][0] + m);
+            p.g = (unsigned char) Clamp255(base[sub][1] + m);
+            p.b = (unsigned char) Clamp255(base[sub][2] + m);
+            p.a = 255;
+        }
+    }
+}
+
+//
+// The best table and pixel indices for the given pixels of a subblock
+// around one base color. Returns the squared error.
+//
+static int
+ETC1FitSubblock(const STColor4ub* const* pixels, const int* indices,
+                const int* base, int* bestTable, int* bestIndices)
+{
+    int bestError = -1;
+
+    for (int t = 0; t < 8; ++t) {
+        int error = 0;
+        int chosen[8];
+
+        for (int p = 0; p < 8; ++p) {
+            int pixelBest = -1;
+            for (int index = 0; index < 4; ++index) {
+                int m = ETC1Modifier(t, index);
+                int dr = Clamp255(base[0] + m) - pixels[p]->r;
+                int dg = Clamp255(base[1] + m) - pixels[p]->g;
+                int db = Clamp255(base[2] + m) - pixels[p]->b;
+                int e = dr * dr + dg * dg + db * db;
+                if (pixelBest < 0 || e < pixelBest) {
+                    pixelBest = e;
+                    chosen[p] = index;
+                }
+            }
+            error += pixelBest;
+        }
+
+        if (bestError < 0 || error < bestError) {
+            bestError = error;
+            *bestTable = t;
+            for (int p = 0; p < 8; ++p)
+                bestIndices[indices[p]] = chosen[p];
+        }
+    }
+
+    return bestError;
+}
+
+//
+// Compress 16 pixels, in[y*4 + x], to a block. Both subblock
+// orientations are tried, each in individual mode (4 bit base colors)
+// and, when the two average colors are close enough, differential mode
+// (5 bit base colors); the base colors are the subblock averages.
+//
+static void
+ETC1EncodeBlock(const STColor4ub* in, unsigned char* block)
+{
+    int bestError = -1;
+    unsigned int bestHi = 0, bestLo = 0;
+
+    for (int flip = 0; flip < 2; ++flip) {
+        const STColor4ub* pixels[2][8];
+        int indices[2][8];
+        int count[2] = { 0, 0 };
+        int sum[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+
+        for (int x = 0; x < 4; ++x) {
+            for (int y = 0; y < 4; ++y) {
+                int sub = flip ? (y >= 2) : (x >= 2);
+                const STColor4ub* p = &in[y * 4 + x];
+                pixels[sub][count[sub]] = p;
+                indices[sub][count[sub]] = x * 4 + y;
+                count[sub]++;
+                sum[sub][0] += p->r;
+                sum[sub][1] += p->g;
+                sum[sub][2] += p->b;
+            }
+        }
+
+        for (int diff = 0; diff < 2; ++diff) {
+            int quant[2][3];
+            int base[2][3];
+            bool fits = true;
+
+            for (int s = 0; s < 2; ++s) {
+                for (int c = 0; c < 3; ++c) {
+                    // round the average (sum / 8) to 4 or 5 bits
+                    int levels = diff ? 31 : 15;
+                    int q = (sum[s][c] * levels + 255 * 4) / (255 * 8);
+                    quant[s][c] = q;
+                    base[s][c] = diff ? (q << 3) | (q >> 2) : (q << 4) | q;
+                }
+            }
+
+            // a flipped block with a difference of -4 couldn't be turned
+            // upside down exactly (see ETC1FlipBlock), so it isn't used
+            if (diff) {
+                for (int c = 0; c < 3; ++c) {
+                    int d = quant[1][c] - quant[0][c];
+                    if (d < (flip ? -3 : -4) || d > 3)
+                        fits = false;
+                }
+            }
+            if (!fits)
+                continue;
+
+            int table[2];
+            int pixelIndices[16];
+            int error = 0;
+            for (int s = 0; s < 2; ++s)
+                error += ETC1FitSubblock(pixels[s], indices[s], base[s],
+                                         &table[s], pixelIndices);
+
+            if (bestError >= 0 && error >= bestError)
+                continue;
+
+            unsigned int hi = 0, lo = 0;
+            for (int c = 0; c < 3; ++c) {
+                int shift = 27 - c * 8;
+                if (diff) {
+                    int d = quant[1][c] - quant[0][c];
+                    hi |= quant[0][c] << shift;
+                    hi |= (d & 7) << (shift - 3);
+                }
+                else {
+                    hi |= quant[0][c] << (shift + 1);
+                    hi |= quant[1][c] << (shift - 3);
+                }
+            }
+            hi |= (table[0] << 5) | (table[1] << 2) | (diff << 1) | flip;
+
+            for (int i = 0; i < 16; ++i) {
+                lo |= ((pixelIndices[i] >> 1) & 1) << (16 + i);
+                lo |= (pixelIndices[i] & 1) << i;
+            }
+
+            bestError = error;
+            bestHi = hi;
+            bestLo = lo;
+        }
+    }
+
+    for (int b = 0; b < 4; ++b) {
+        block[b] = (bestHi >> (24 - b * 8)) & 0xff;
+        block[4 + b] = (bestLo >> (24 - b * 8)) & 0xff;
+    }
+}
+
+//
+// Compress width x height pixels, stored row by row, to blocks. Blocks
+// that stick out past the last column or row repeat it.
+//
+static void
+ETC1Encode(const STColor4ub* pixels, int width, int height,
+           unsigned char* block)
+{
+    STColor4ub in[16];
+
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            for (int y = 0; y < 4; ++y) {
+                int sy = by + y < height ? by + y : height - 1;
+                for (int x = 0; x < 4; ++x) {
+                    int sx = bx + x < width ? bx + x : width - 1;
+                    in[y * 4 + x] = pixels[(size_t) sy * width + sx];
+                }
+            }
+            ETC1EncodeBlock(in, block);
+            block += ETC1_BLOCK_SIZE;
+        }
+    }
+}
+
+//
+// Expand every block, keeping the pixels that lie inside the image.
+//
+static void
+ETC1Decode(const unsigned char* block, int width, int height,
+           STColor4ub* pixels)
+{
+    STColor4ub out[16];
+
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            ETC1DecodeBlock(block, out);
+            block += ETC1_BLOCK_SIZE;
+
+            for (int y = 0; y < 4 && by + y < height; ++y) {
+                for (int x = 0; x < 4 && bx + x < width; ++x)
+                    pixels[(size_t) (by + y) * width + bx + x] = out[y * 4 + x];
+            }
+        }
+    }
+}
+
+//
+// Turn a block upside down. The pixel indices of each column are
+// reversed; with flip set, the subblocks are the top and bottom halves,
+// so their base colors and tables trade places too. That is exact,
+// except that a differential block whose second color is 4 below the
+// first can't hold the difference the other way round; those are
+// decoded and compressed again.
+//
+static void
+ETC1FlipBlock(unsigned char* block)
+{
+    unsigned int hi = (block[0] << 24) | (block[1] << 16) |
+        (block[2] << 8) | block[3];
+    unsigned int lo = (block[4] << 24) | (block[5] << 16) |
+        (block[6] << 8) | block[7];
+
+    bool diff = (hi & 2) != 0;
+    bool flip = (hi & 1) != 0;
+
+    if (flip) {
+        unsigned int swapped = (hi & 3) | (((hi >> 5) & 7) << 2) |
+            (((hi >> 2) & 7) << 5);
+
+        for (int c = 0; c < 3; ++c) {
+            int shift = 27 - c * 8;
+            if (diff) {
+                int c1 = (hi >> shift) & 0x1f;
+                int d = (hi >> (shift - 3)) & 0x7;
+                if (d == 4) {
+                    STColor4ub pixels[16], flipped[16];
+                    ETC1DecodeBlock(block, pixels);
+                    for (int i = 0; i < 16; ++i)
+                        flipped[(3 - i / 4) * 4 + i % 4] = pixels[i];
+                    ETC1EncodeBlock(flipped, block);
+                    return;
+                }
+                int c2 = c1 + ((d & 4) ? d - 8 : d);
+                swapped |= (c2 & 0x1f) << shift;
+                swapped |= (-(c2 - c1) & 7) << (shift - 3);
+            }
+            else {
+                int c1 = (hi >> (shift + 1)) & 0xf;
+                int c2 = (hi >> (shift - 3)) & 0xf;
+                swapped |= c2 << (shift + 1);
+                swapped |= c1 << (shift - 3);
+            }
+        }
+        hi = swapped;
+    }
+
+    // bit x*4 + y of each half is column x, row y
+    unsigned int reversed = 0;
+    for (int i = 0; i < 32; ++i)
+        reversed |= ((lo >> i) & 1) << ((i & ~3) | (3 - (i & 3)));
+    lo = reversed;
+
+    for (int b = 0; b < 4; ++b) {
+        block[b] = (hi >> (24 - b * 8)) & 0xff;
+        block[4 + b] = (lo >> (24 - b * 8)) & 0xff;
+    }
+}
+
+//
+// Turn the blocks of a width x height image upside down, between top
+// row first and bottom row first. When the height isn't a multiple of
+// 4, the rows padding out the last block row would have to move to
+// the other end, shifting every row; then the image is decoded and
+// compressed again instead.
+//
+static void
+ETC1FlipRows(std::vector<unsigned char>& data, int width, int height)
+{
+    if (height % 4 != 0) {
+        std::vector<STColor4ub> pixels((size_t) width * height);
+        std::vector<STColor4ub> flipped(pixels.size());
+        ETC1Decode(&data[0], width, height, &pixels[0]);
+        for (int y = 0; y < height; ++y)
+            std::copy(pixels.begin() + (size_t) y * width,
+                      pixels.begin() + (size_t) (y + 1) * width,
+                      flipped.begin() + (size_t) (height - 1 - y) * width);
+        ETC1Encode(&flipped[0], width, height, &data[0]);
+        return;
+    }
+
+    size_t rowSize = (size_t) ((width + 3) / 4) * ETC1_BLOCK_SIZE;
+    int numRows = height / 4;
+    std::vector<unsigned char> row(rowSize);
+
+    for (int top = 0, bottom = numRows - 1; top <= bottom; ++top, --bottom) {
+        unsigned char* a = &data[top * rowSize];
+        unsigned char* b = &data[bottom * rowSize];
+        if (a != b) {
+            memcpy(&row[0], a, rowSize);
+            memcpy(a, b, rowSize);
+            memcpy(b, &row[0], rowSize);
+        }
+        for (size_t i = 0; i < rowSize; i += ETC1_BLOCK_SIZE) {
+            ETC1FlipBlock(a + i);
+            if (a != b)
+                ETC1FlipBlock(b + i);
+        }
+    }
+}
+
+//
+// Load a compressed image from a PKM file.
+//
+STCompressedImage::STCompressedImage(const std::string& filename)
+    : mFormat(kETC1)
+    , mWidth(0)
+    , mHeight(0)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "STCompressedImage() - Could not open '%s'.\n",
+                filename.c_str());
+        throw std::runtime_error("Error in STCompressedImage");
+    }
+
+    // Version 2.0 files (ETC2) are accepted as long as they hold ETC1
+    unsigned char header[PKM_HEADER_SIZE];
+    if (fread(header, 1, PKM_HEADER_SIZE, file) != PKM_HEADER_SIZE ||
+        memcmp(header, "PKM ", 4) != 0 ||
+        (memcmp(header + 4, "10", 2) != 0 &&
+         memcmp(header + 4, "20", 2) != 0) ||
+        PKMGet16(header + 6) != 0) {
+        fprintf(stderr, "STCompressedImage() - '%s' is not an ETC1 PKM file.\n",
+                filename.c_str());
+        fclose(file);
+        throw std::runtime_error("Error in STCompressedImage");
+    }
+
+    mWidth = PKMGet16(header + 12);
+    mHeight = PKMGet16(header + 14);
+    mData.resize(ETC1DataSize(mWidth, mHeight));
+
+    if (mWidth == 0 || mHeight == 0 ||
+        fread(&mData[0], 1, mData.size(), file) != mData.size()) {
+        fprintf(stderr, "STCompressedImage() - '%s' is truncated.\n",
+                filename.c_str());
+        fclose(file);
+        throw std::runtime_error("Error in STCompressedImage");
+    }
+
+    fclose(file);
+
+    ETC1FlipRows(mData, mWidth, mHeight);
+}
+
+//
+// Compress the pixels of an image to ETC1. Blocks that stick out past
+// the right or top edge repeat the last column or row.
+//
+STCompressedImage::STCompressedImage(const STImage* image)
+    : mFormat(kETC1)
+    , mWidth(image->GetWidth())
+    , mHeight(image->GetHeight())
+{
+    mData.resize(ETC1DataSize(mWidth, mHeight));
+    ETC1Encode(image->GetPixels(), mWidth, mHeight, &mData[0]);
+}
+
+//
+// Write the compressed image to a PKM file.
+//
+STStatus
+STCompressedImage::Save(const std::string& filename) const
+{
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "STCompressedImage::Save() - Could not open '%s'.\n",
+                filename.c_str());
+        return ST_ERROR;
+    }
+
+    unsigned char header[PKM_HEADER_SIZE];
+    memcpy(header, "PKM 10", 6);
+    PKMPut16(header + 6, 0);
+    PKMPut16(header + 8, (mWidth + 3) & ~3);
+    PKMPut16(header + 10, (mHeight + 3) & ~3);
+    PKMPut16(header + 12, mWidth);
+    PKMPut16(header + 14, mHeight);
+
+    std::vector<unsigned char> data(mData);
+    ETC1FlipRows(data, mWidth, mHeight);
+
+    bool ok = fwrite(header, 1, PKM_HEADER_SIZE, file) == PKM_HEADER_SIZE &&
+        fwrite(&data[0], 1, data.size(), file) == data.size();
+
+    fclose(file);
+
+    return ok ? ST_OK : ST_ERROR;
+}
+
+//
+// Expand the blocks in software.
+//
+void
+STCompressedImage::Decode(STColor4ub* pixels) const
+{
+    ETC1Decode(&mData[0], mWidth, mHeight, pixels);
+}
+
+bool
+STCompressedImage::IsCompressedFile(const std::string& filename)
+{
+    return STGetExtension(filename).compare("PKM") == 0;
+}
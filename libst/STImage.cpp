@@ -13,10 +13,13 @@
 // and PNG formats are supported).
 // Returns NULL on failure.
 //
-STImage::STImage(const std::string& filename)
+STImage::STImage(const std::string& filename,
+                 int targetWidth, int targetHeight)
     : mWidth(-1)
     , mHeight(-1)
     , mPixels(NULL)
+    , mMapping(NULL)
+    , mMappingSize(0)
 {
 
     // Determine the right routine based on the file's extension.
@@ -30,7 +33,13 @@ STImage::STImage(const std::string& filename)
         LoadPNG(filename);
     }
     else if (ext.compare("JPG") == 0 || ext.compare("JPEG") == 0) {
-        LoadJPG(filename);
+        LoadJPG(filename, targetWidth, targetHeight);
+    }
+    else if (ext.compare("RGBA") == 0) {
+        LoadRaw(filename);
+    }
+    else if (ext.compare("PKM") == 0) {
+        LoadPKM(filename);
     }
     else {
         fprintf(stderr,
@@ -40,11 +49,23 @@ STImage::STImage(const std::string& filename)
     } 
 }
 
+//
+// Whether the file's format is decoded at reduced scale when
+// given a target size.
+//
+bool STImage::DecodesScaled(const std::string& filename)
+{
+    std::string ext = STGetExtension( filename );
+    return ext.compare("JPG") == 0 || ext.compare("JPEG") == 0;
+}
+
 //
 // Construct a new image of the specified width and height,
 // filled completely with the specified pixel color.
 //
 STImage::STImage(int width, int height, Pixel color)
+    : mMapping(NULL)
+    , mMappingSize(0)
 {
     Initialize(width, height);
 
@@ -65,7 +86,7 @@ void STImage::Initialize(int width, int height)
     mWidth = width;
     mHeight = height;
 
-    int numPixels = mWidth * mHeight;
+    size_t numPixels = (size_t) mWidth * mHeight;
     mPixels = new Pixel[numPixels];
 }
 
@@ -74,7 +95,10 @@ void STImage::Initialize(int width, int height)
 //
 STImage::~STImage()
 {
-    if (mPixels != NULL) {
+    if (mMapping != NULL) {
+        UnmapRaw();
+    }
+    else if (mPixels != NULL) {
         delete [] mPixels;
     }
 }
@@ -100,6 +124,12 @@ STStatus STImage::Save(const std::string& filename) const
     else if (ext.compare("JPG") == 0) {
         return SaveJPG(filename);
     }
+    else if (ext.compare("RGBA") == 0) {
+        return SaveRaw(filename);
+    }
+    else if (ext.compare("PKM") == 0) {
+        return SavePKM(filename);
+    }
     else {
         fprintf(stderr,
                 "STImage::Save() - Unknown image file type \"%s\".\n",
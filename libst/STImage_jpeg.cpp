@@ -2,6 +2,7 @@
 #include "STImage.h"
 
 #include "st.h"
+#include "STPixelConvert.h"
 
 extern "C" {
 #include <jpeglib.h>    // libjpeg header
@@ -32,9 +33,12 @@ STJpegErrorExit(j_common_ptr cinfo)
 }
 
 //
-// Create an STImage from the contents of a JPG file via the libjpeg API
+// Create an STImage from the contents of a JPG file via the libjpeg API,
+// decoded at the smallest of 1/8, 1/4, 1/2 and full scale that is still
+// at least targetWidth x targetHeight
 //
-void STImage::LoadJPG(const std::string& filename)
+void STImage::LoadJPG(const std::string& filename,
+                      int targetWidth, int targetHeight)
 {
     // Open image file.
     FILE* imgFile = fopen(filename.c_str(), "rb");
@@ -59,6 +63,17 @@ void STImage::LoadJPG(const std::string& filename)
     jpeg_create_decompress(&cinfo);
     jpeg_stdio_src(&cinfo, imgFile);
     jpeg_read_header(&cinfo, TRUE);
+
+    // libjpeg scales down in the DCT, which saves most of the decoding
+    // work as well as the memory; without a target, decode at full scale
+    int scaleDenom = (targetWidth > 0 && targetHeight > 0) ? 8 : 1;
+    while (scaleDenom > 1 &&
+           ((int) (cinfo.image_width + scaleDenom - 1) / scaleDenom < targetWidth ||
+            (int) (cinfo.image_height + scaleDenom - 1) / scaleDenom < targetHeight))
+        scaleDenom /= 2;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+
     jpeg_start_decompress(&cinfo);
 
     int rowStride = cinfo.output_width * cinfo.output_components;
@@ -86,20 +101,10 @@ void STImage::LoadJPG(const std::string& filename)
         unsigned char* buf = rowBuffer[0];
         if (cinfo.output_components == 3) {
             // RGB data
-            for (int ii = 0; ii < width; ++ii) {
-                curPixel->r = *buf++;
-                curPixel->g = *buf++;
-                curPixel->b = *buf++;
-                curPixel->a = 255;
-                curPixel++;
-            }
+            STConvertRGBToRGBA(buf, curPixel, width);
         } else {
             // Greyscale data
-            for (int ii = 0; ii < width; ++ii) {
-                curPixel->r = curPixel->g = curPixel->b = *buf++;
-                curPixel->a = 255;
-                curPixel++;
-            }
+            STConvertGrayToRGBA(buf, curPixel, width);
         }
     }
 
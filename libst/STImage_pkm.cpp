@@ -0,0 +1,30 @@
+// STImage_pkm.cpp
+#include "STImage.h"
+
+#include "STCompressedImage.h"
+#include "st.h"
+
+#include <string>
+
+//
+// Creates an STImage from an ETC1 compressed PKM file, decoding it in
+// software
+//
+void STImage::LoadPKM(const std::string& filename)
+{
+    STCompressedImage compressed(filename);
+
+    Initialize(compressed.GetWidth(), compressed.GetHeight());
+    compressed.Decode(mPixels);
+}
+
+//
+// Compresses the STImage to ETC1 and writes it to a PKM file. The alpha
+// channel is lost.
+//
+STStatus
+STImage::SavePKM(const std::string& filename) const
+{
+    STCompressedImage compressed(this);
+    return compressed.Save(filename);
+}
@@ -66,6 +66,8 @@ void STImage::LoadPNG(const std::string& filename)
     if (setjmp(png_jmpbuf(pngPtr))) {
         fprintf(stderr, "STImage::LoadPNG() - Error reading '%s'.\n",
                 filename.c_str());
+        delete [] mPixels;
+        mPixels = NULL;
         png_destroy_read_struct(&pngPtr, &infoPtr, (png_infopp)NULL);
         fclose(imgFile);
         throw std::runtime_error("Error in LoadPNG");
@@ -74,91 +76,58 @@ void STImage::LoadPNG(const std::string& filename)
     png_init_io(pngPtr, imgFile);
     png_set_sig_bytes(pngPtr, 8);
 
-    // The following code used the libpng high level interface
-    // to read data from the file into the array of STColor4ub structs
-    // representing an image in this class.  Format conversion into 8-bit
-    // RGBA as currently required by this class, requires an additional
-    // buffer copy.  Using the libpng **low-level interface** this buffer
-    // copy and the associated buffer double allocation could be avoided.
-    // The code would be complicated slightly with additional libpng
-    // transform calls, so I will leave this for later if performance or
-    // memory footprint becomes an issue.
-
-    // These transforms get us very close to 8 bit per channel RGBA, but
-    // not quite (won't extend from 1 or 3 components to 4.  Must use low
-    // level interface to do this.
-    int transforms =            
-            PNG_TRANSFORM_PACKING |
-            PNG_TRANSFORM_PACKSWAP |
-            PNG_TRANSFORM_EXPAND |
-            PNG_TRANSFORM_SHIFT;
+    // Use the libpng low-level interface, so that libpng itself converts
+    // every pixel format to 8 bit per channel RGBA and each row can be
+    // decoded straight into its place in the STImage's pixel array, with
+    // no intermediate copy of the whole image.
+    png_read_info(pngPtr, infoPtr);
 
-    
-    // Tell libpng to load the image into memory
-    png_read_png(pngPtr, infoPtr, transforms, NULL);
+    png_uint_32 width, height;
+    int bitDepth, colorType;
+    png_get_IHDR(pngPtr, infoPtr, &width, &height, &bitDepth, &colorType,
+                 NULL, NULL, NULL);
 
-    
-    // libpng exposes the data as an array of arrays of bytes
-    png_bytepp pngRowPointers = png_get_rows(pngPtr, infoPtr);
+    // 16 bit channels down to 8, and 1, 2 or 4 bit pixels up to 8
+    if (bitDepth == 16)
+        png_set_strip_16(pngPtr);
+    png_set_packing(pngPtr);
+    png_set_expand(pngPtr);
+
+    // honor significant bits, as the PNG_TRANSFORM_SHIFT transform did
+    png_color_8p sigBit;
+    if (png_get_sBIT(pngPtr, infoPtr, &sigBit))
+        png_set_shift(pngPtr, sigBit);
+
+    // monochrome to RGB
+    if (colorType == PNG_COLOR_TYPE_GRAY ||
+        colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(pngPtr);
+
+    // add an opaque alpha channel unless there is one (or expanding tRNS
+    // transparency creates one)
+    if (!(colorType & PNG_COLOR_MASK_ALPHA) &&
+        !png_get_valid(pngPtr, infoPtr, PNG_INFO_tRNS))
+        png_set_filler(pngPtr, 0xff, PNG_FILLER_AFTER);
+
+    // interlaced images are read in several passes over every row
+    int numPasses = png_set_interlace_handling(pngPtr);
+
+    png_read_update_info(pngPtr, infoPtr);
 
-    int width = png_get_image_width(pngPtr, infoPtr);
-    int height = png_get_image_height(pngPtr, infoPtr);
     Initialize(width, height);
-    STColor4ub* pixels = mPixels;
-
-    int numChannels = png_get_channels(pngPtr, infoPtr);
-
-    // Now copy the data read by libpng into the STImage class'
-    // contiguous allocation of pixel data.  In doing so, explode
-    // single channel images or images without an alpha channle
-    // into full RGBA pixels.  
-    //
-    // We also need to flip the order of the rows of data.  Data in
-    // the png file begins with the topmost row of the image.  The
-    // STImage class stores data bottom row first to be consistent
-    // with OpenGL pixel formats
-    for (int i = 0; i < height; ++i) {
-
-        png_bytep srcPtr = pngRowPointers[height-i-1]; 
-        STColor4ub* curPixel = &pixels[ i*width ];
-
-        for (int j = 0; j < width; ++j) {
-
-            switch (numChannels) {
-
-            // monochrome, no alpha
-            case 1:
-                curPixel->r = curPixel->g = curPixel->b = *srcPtr++;
-                curPixel->a = 255;
-                break;
-
-            // monochrome, with alpha
-            case 2:
-                curPixel->r = curPixel->g = curPixel->b = *srcPtr++;
-                curPixel->a = *srcPtr++;
-                break;
-
-            // RGB, no alpha
-            case 3:
-                curPixel->r = *srcPtr++;
-                curPixel->g = *srcPtr++;
-                curPixel->b = *srcPtr++;
-                curPixel->a = 255;
-                break;
-                
-            // RGBA
-            case 4:
-                curPixel->r = *srcPtr++;
-                curPixel->g = *srcPtr++;
-                curPixel->b = *srcPtr++;
-                curPixel->a = *srcPtr++;
-                break;
-            }
-
-            curPixel++;
+
+    // Data in the png file begins with the topmost row of the image.
+    // The STImage class stores data bottom row first to be consistent
+    // with OpenGL pixel formats, so each row goes to its flipped place.
+    for (int pass = 0; pass < numPasses; ++pass) {
+        for (png_uint_32 i = 0; i < height; ++i) {
+            png_bytep row = (png_bytep) &mPixels[ (height-i-1)*width ];
+            png_read_row(pngPtr, row, NULL);
         }
     }
 
+    png_read_end(pngPtr, NULL);
+
 
     // Clean up libpng.
     png_destroy_read_struct(&pngPtr, &infoPtr, (png_infopp)NULL);
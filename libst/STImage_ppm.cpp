@@ -2,14 +2,23 @@
 #include "STImage.h"
 
 #include "st.h"
+#include "STPixelConvert.h"
 
+#include <ctype.h>
 #include <string.h>
 #include <stdio.h>
+#include <vector>
 
 // The PPM format guarantees no line in the file is longer
 // than 70 characters. We are a little conservative here.
 static const int MAX_PPM_LINE = 80;
 
+// Largest width or height accepted, as for raw images; anything bigger
+// is taken to be a corrupt header rather than allocated.
+static const int MAX_PPM_SIZE = 0x7fff;
+// Largest header value of any kind (maxVal can be up to 65535).
+static const int MAX_PPM_VALUE = 65535;
+
 //
 // Pulls the next line of a PPM file out of the file stream and
 // strips out any comments.
@@ -28,21 +37,131 @@ PPMNextLine(FILE* ppmFile, char* line)
 }
 
 //
-// Creates an STImage from the contents of a PPM file
+// Reads the next number from the header of a binary PPM file, skipping
+// whitespace and comments, and consumes the single whitespace character
+// that follows it (so after the last header value, the file is positioned
+// at the pixel data).
+// Returns 0 if there is no number, or it is over MAX_PPM_VALUE.
+//
+static int
+PPMNextValue(FILE* ppmFile, int* value)
+{
+    int c = getc(ppmFile);
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n')
+                c = getc(ppmFile);
+        }
+        c = getc(ppmFile);
+    }
+
+    if (c == EOF || !isdigit(c))
+        return 0;
+
+    int val = 0;
+    while (c != EOF && isdigit(c)) {
+        val = val * 10 + (c - '0');
+        if (val > MAX_PPM_VALUE)
+            return 0;
+        c = getc(ppmFile);
+    }
+
+    *value = val;
+    return 1;
+}
+
+//
+// Reads the pixel data of a binary PPM (P6, numChannels 3) or PGM (P5,
+// numChannels 1) file into pixels, which must hold width*height pixels.
+// Samples are one byte, or two bytes most significant first if maxVal is
+// over 255.
+// Returns 0 if the file is too short.
+//
+static int
+PPMReadBinaryPixels(FILE* ppmFile, STColor4ub* pixels, int width,
+                    int height, int maxVal, int numChannels)
+{
+    int bytesPerSample = maxVal > 255 ? 2 : 1;
+    size_t numSamples = (size_t) width * numChannels;
+    size_t rowBytes = (size_t) numSamples * bytesPerSample;
+    std::vector<unsigned char> row(rowBytes);
+
+    for (int ii = 0; ii < height; ++ii) {
+
+        if (fread(&row[0], 1, rowBytes, ppmFile) != rowBytes)
+            return 0;
+
+        // scale to 8 bit samples, in place
+        if (maxVal != 255) {
+            for (size_t jj = 0; jj < numSamples; ++jj) {
+                int val = bytesPerSample == 2 ?
+                    (row[jj*2] << 8) | row[jj*2+1] : row[jj];
+                row[jj] = (unsigned char) (val * 255 / maxVal);
+            }
+        }
+
+        // The file lists the topmost row first. The STImage class stores
+        // data bottom row first to be consistent with OpenGL pixel formats.
+        STColor4ub* dst = &pixels[ (size_t) (height-ii-1) * width ];
+        if (numChannels == 3)
+            STConvertRGBToRGBA(&row[0], dst, width);
+        else
+            STConvertGrayToRGBA(&row[0], dst, width);
+    }
+
+    return 1;
+}
+
+//
+// Creates an STImage from the contents of a PPM file: ASCII (P3) or
+// binary (P6) RGB, or binary (P5) greyscale
 //
 void STImage::LoadPPM(const std::string& filename)
 {
-    FILE* imgFile = fopen(filename.c_str(), "r");
+    FILE* imgFile = fopen(filename.c_str(), "rb");
     if (!imgFile) {
         fprintf(stderr, "STImage::LoadPPM() - Could not open '%s'.\n",
                 filename.c_str());
         throw std::runtime_error("Error in LoadPPM");
     }
 
-    // Read the PPM header, it should begin with the characters 'P3'.
-    // If it doesn't, complain about an invalid format
+    // Read the PPM header, it should begin with the characters 'P3',
+    // 'P5' or 'P6'. If it doesn't, complain about an invalid format
     char line[MAX_PPM_LINE];
-    fgets(line, 3, imgFile);
+    if (fgets(line, 3, imgFile) == NULL)
+        line[0] = '\0';
+
+    if (strcmp(line, "P6") == 0 || strcmp(line, "P5") == 0) {
+        int numChannels = (line[1] == '6') ? 3 : 1;
+
+        int width = 0, height = 0, maxVal = 0;
+        if (!PPMNextValue(imgFile, &width) ||
+            !PPMNextValue(imgFile, &height) ||
+            !PPMNextValue(imgFile, &maxVal) ||
+            width <= 0 || height <= 0 ||
+            width > MAX_PPM_SIZE || height > MAX_PPM_SIZE ||
+            maxVal <= 0 || maxVal > MAX_PPM_VALUE) {
+            fprintf(stderr, "STImage::LoadPPM() - Invalid header in '%s'.\n",
+                    filename.c_str());
+            fclose(imgFile);
+            throw std::runtime_error("Error in LoadPPM");
+        }
+
+        Initialize(width, height);
+
+        if (!PPMReadBinaryPixels(imgFile, mPixels, width, height,
+                                 maxVal, numChannels)) {
+            fprintf(stderr, "STImage::LoadPPM() - '%s' is truncated.\n",
+                    filename.c_str());
+            delete [] mPixels;
+            mPixels = NULL;
+            fclose(imgFile);
+            throw std::runtime_error("Error in LoadPPM");
+        }
+
+        fclose(imgFile);
+        return;
+    }
 
     if (strcmp(line, "P3") != 0) {
         fprintf(stderr, "Invalid PPM file format.\n");
@@ -56,7 +175,7 @@ void STImage::LoadPPM(const std::string& filename)
     int header[3];
     while (pos < 3 && PPMNextLine(imgFile, line)) {
         char* tok = strtok(line, " \t\n");
-        while (tok) {
+        while (tok && pos < 3) {
             int val = 0;
             sscanf(tok, "%d", &val);
             header[pos++] = val;
@@ -64,6 +183,16 @@ void STImage::LoadPPM(const std::string& filename)
         } 
     }
 
+    if (pos < 3 ||
+        header[0] <= 0 || header[1] <= 0 ||
+        header[0] > MAX_PPM_SIZE || header[1] > MAX_PPM_SIZE ||
+        header[2] <= 0 || header[2] > MAX_PPM_VALUE) {
+        fprintf(stderr, "STImage::LoadPPM() - Invalid header in '%s'.\n",
+                filename.c_str());
+        fclose(imgFile);
+        throw std::runtime_error("Error in LoadPPM");
+    }
+
     int width = header[0];
     int height = header[1];
     int maxVal = header[2];
@@ -107,6 +236,10 @@ void STImage::LoadPPM(const std::string& filename)
     }
     
     fclose(imgFile);
+
+    // The file lists the topmost row first. The STImage class stores data
+    // bottom row first to be consistent with OpenGL pixel formats.
+    STFlipRows(pixels, width * sizeof(STColor4ub), height);
 }
 
 //
@@ -126,10 +259,12 @@ STImage::SavePPM(const std::string& filename) const
     fprintf(imgFile, "%d %d\n", mWidth, mHeight);
     fprintf(imgFile, "255\n");
 
-    int numPixels = mWidth * mHeight;
-    for (int ii = 0; ii < numPixels; ++ii) {
-        STColor4ub pixel = mPixels[ii];
-        fprintf(imgFile,"%d %d %d\n", pixel.r, pixel.g, pixel.b);
+    // topmost row first
+    for (int row = mHeight-1; row >= 0; --row) {
+        for (int ii = 0; ii < mWidth; ++ii) {
+            STColor4ub pixel = mPixels[row*mWidth + ii];
+            fprintf(imgFile,"%d %d %d\n", pixel.r, pixel.g, pixel.b);
+        }
     }
     fclose(imgFile);
 
@@ -0,0 +1,207 @@
+// STImage_raw.cpp
+#include "STImage.h"
+
+#include "st.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// Raw image files hold a 16 byte header:
+//
+//   "STRA"    magic
+//   version   4 byte little-endian, currently 1
+//   width     4 byte little-endian
+//   height    4 byte little-endian
+//
+// followed by width*height 8 bit RGBA pixels, bottom row first, which is
+// exactly how STImage stores them in memory.
+//
+static const int RAW_HEADER_SIZE = 16;
+static const unsigned int RAW_VERSION = 1;
+
+static unsigned int
+RawGet32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static void
+RawPut32(unsigned char* p, unsigned int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+//
+// Checks a raw file header, and gets the image size from it.
+// Returns false if the header is invalid.
+//
+static bool
+RawParseHeader(const unsigned char* header, int* width, int* height)
+{
+    if (memcmp(header, "STRA", 4) != 0 ||
+        RawGet32(header + 4) != RAW_VERSION)
+        return false;
+
+    unsigned int w = RawGet32(header + 8);
+    unsigned int h = RawGet32(header + 12);
+    if (w == 0 || h == 0 || w > 0x7fff || h > 0x7fff)
+        return false;
+
+    *width = (int) w;
+    *height = (int) h;
+    return true;
+}
+
+#ifndef _WIN32
+
+//
+// Create an STImage from a raw file by mapping it into memory. The pixel
+// array points straight into the mapping, so the file is never decoded or
+// copied; it is mapped privately, so writing to the pixels doesn't change
+// the file.
+//
+void STImage::LoadRaw(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "STImage::LoadRaw() - Could not open '%s'.\n",
+                filename.c_str());
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < RAW_HEADER_SIZE) {
+        fprintf(stderr, "STImage::LoadRaw() - Invalid raw file '%s'.\n",
+                filename.c_str());
+        close(fd);
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    // Fault all of the pages in now, rather than when the pixels are
+    // first touched (typically by the texture upload on the GL thread).
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+
+    size_t size = (size_t) st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "STImage::LoadRaw() - Could not map '%s'.\n",
+                filename.c_str());
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    int width, height;
+    if (!RawParseHeader((const unsigned char*) mapping, &width, &height) ||
+        size < RAW_HEADER_SIZE + (size_t) width * height * sizeof(Pixel)) {
+        fprintf(stderr, "STImage::LoadRaw() - Invalid raw file '%s'.\n",
+                filename.c_str());
+        munmap(mapping, size);
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    mWidth = width;
+    mHeight = height;
+    mPixels = (Pixel*) ((unsigned char*) mapping + RAW_HEADER_SIZE);
+    mMapping = mapping;
+    mMappingSize = size;
+}
+
+//
+// Release the mapping made by LoadRaw().
+//
+void STImage::UnmapRaw()
+{
+    munmap(mMapping, mMappingSize);
+    mMapping = NULL;
+    mPixels = NULL;
+}
+
+#else
+
+//
+// Create an STImage from a raw file. Without mmap, the pixels are read
+// into a regular allocation.
+//
+void STImage::LoadRaw(const std::string& filename)
+{
+    FILE* imgFile = fopen(filename.c_str(), "rb");
+    if (!imgFile) {
+        fprintf(stderr, "STImage::LoadRaw() - Could not open '%s'.\n",
+                filename.c_str());
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    unsigned char header[RAW_HEADER_SIZE];
+    int width, height;
+    if (fread(header, 1, RAW_HEADER_SIZE, imgFile) != RAW_HEADER_SIZE ||
+        !RawParseHeader(header, &width, &height)) {
+        fprintf(stderr, "STImage::LoadRaw() - Invalid raw file '%s'.\n",
+                filename.c_str());
+        fclose(imgFile);
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    Initialize(width, height);
+
+    size_t numPixels = (size_t) width * height;
+    if (fread(mPixels, sizeof(Pixel), numPixels, imgFile) != numPixels) {
+        fprintf(stderr, "STImage::LoadRaw() - Invalid raw file '%s'.\n",
+                filename.c_str());
+        delete [] mPixels;
+        mPixels = NULL;
+        fclose(imgFile);
+        throw std::runtime_error("Error in LoadRaw");
+    }
+
+    fclose(imgFile);
+}
+
+void STImage::UnmapRaw()
+{
+}
+
+#endif // _WIN32
+
+//
+// Create a raw file from the pixel contents of the STImage
+//
+STStatus
+STImage::SaveRaw(const std::string& filename) const
+{
+    FILE* imgFile = fopen(filename.c_str(), "wb");
+    if (!imgFile) {
+        fprintf(stderr, "STImage::SaveRaw() - Could not open '%s'.\n",
+                filename.c_str());
+        return ST_ERROR;
+    }
+
+    unsigned char header[RAW_HEADER_SIZE];
+    memcpy(header, "STRA", 4);
+    RawPut32(header + 4, RAW_VERSION);
+    RawPut32(header + 8, mWidth);
+    RawPut32(header + 12, mHeight);
+
+    size_t numPixels = (size_t) mWidth * mHeight;
+    bool ok = fwrite(header, 1, RAW_HEADER_SIZE, imgFile) == RAW_HEADER_SIZE &&
+        fwrite(mPixels, sizeof(Pixel), numPixels, imgFile) == numPixels;
+
+    fclose(imgFile);
+
+    return ok ? ST_OK : ST_ERROR;
+}
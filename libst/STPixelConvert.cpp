@@ -0,0 +1,324 @@
+// STPixelConvert.cpp
+#include "STPixelConvert.h"
+
+#include <string.h>
+#include <vector>
+
+// x86: SSE2 and SSSE3 versions, compiled with per-function target
+// attributes so the rest of the library doesn't require those extensions,
+// and only used if the CPU reports them.
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define ST_PIXEL_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+// ARM: NEON versions. NEON is always there on 64 bit. 32 bit builds are
+// normally for a baseline FPU (the Raspberry Pi 1 has no NEON), so GCC 8
+// and later compile just these functions for NEON with a target attribute,
+// as on x86; older compilers only get them when the whole file is built
+// with -mfpu=neon. Either way 32 bit ARM Linux checks the CPU at runtime.
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define ST_PIXEL_NEON 1
+#define ST_NEON_TARGET
+#elif defined(__arm__) && defined(__ARM_FP) && !defined(__clang__) && \
+    __GNUC__ >= 8
+#define ST_PIXEL_NEON 1
+#define ST_NEON_TARGET __attribute__((target("fpu=neon")))
+#endif
+
+#ifdef ST_PIXEL_NEON
+#include <arm_neon.h>
+#if defined(__linux__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+typedef void (*ConvertFunc)(const unsigned char*, STColor4ub*, int);
+
+//
+// Scalar versions, also used for the pixels left over by the SIMD ones.
+//
+static void
+RGBToRGBAScalar(const unsigned char* src, STColor4ub* dst, int count)
+{
+    for (int ii = 0; ii < count; ++ii) {
+        dst->r = src[0];
+        dst->g = src[1];
+        dst->b = src[2];
+        dst->a = 255;
+        src += 3;
+        dst++;
+    }
+}
+
+static void
+GrayToRGBAScalar(const unsigned char* src, STColor4ub* dst, int count)
+{
+    for (int ii = 0; ii < count; ++ii) {
+        dst->r = dst->g = dst->b = *src++;
+        dst->a = 255;
+        dst++;
+    }
+}
+
+#ifdef ST_PIXEL_X86
+
+//
+// 16 pixels per iteration: each 12 byte group of RGB is shuffled out to
+// 16 bytes of RGBA and the alpha bytes ORed in.
+//
+__attribute__((target("ssse3"))) static void
+RGBToRGBASSSE3(const unsigned char* src, STColor4ub* dst, int count)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                          6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+    int ii = 0;
+    for (; ii + 16 <= count; ii += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) src);
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*) (src + 32));
+
+        __m128i p0 = a;
+        __m128i p1 = _mm_alignr_epi8(b, a, 12);
+        __m128i p2 = _mm_alignr_epi8(c, b, 8);
+        __m128i p3 = _mm_srli_si128(c, 4);
+
+        __m128i* out = (__m128i*) dst;
+        _mm_storeu_si128(out, _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+        _mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+        _mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+        _mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+
+        src += 48;
+        dst += 16;
+    }
+
+    RGBToRGBAScalar(src, dst, count - ii);
+}
+
+//
+// 16 pixels per iteration: interleaving the grey bytes with themselves and
+// with 0xff gives (g, g) and (g, 0xff) pairs, and interleaving those gives
+// (g, g, g, 0xff) pixels.
+//
+__attribute__((target("sse2"))) static void
+GrayToRGBASSE2(const unsigned char* src, STColor4ub* dst, int count)
+{
+    const __m128i opaque = _mm_set1_epi8((char) 0xff);
+
+    int ii = 0;
+    for (; ii + 16 <= count; ii += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i*) src);
+
+        __m128i gg0 = _mm_unpacklo_epi8(g, g);
+        __m128i gg1 = _mm_unpackhi_epi8(g, g);
+        __m128i ga0 = _mm_unpacklo_epi8(g, opaque);
+        __m128i ga1 = _mm_unpackhi_epi8(g, opaque);
+
+        __m128i* out = (__m128i*) dst;
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(gg0, ga0));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gg0, ga0));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(gg1, ga1));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(gg1, ga1));
+
+        src += 16;
+        dst += 16;
+    }
+
+    GrayToRGBAScalar(src, dst, count - ii);
+}
+
+#endif // ST_PIXEL_X86
+
+#ifdef ST_PIXEL_NEON
+
+//
+// 16 pixels per iteration, using the NEON interleaving loads and stores.
+//
+ST_NEON_TARGET static void
+RGBToRGBANEON(const unsigned char* src, STColor4ub* dst, int count)
+{
+    int ii = 0;
+    for (; ii + 16 <= count; ii += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src);
+        uint8x16x4_t rgba;
+        rgba.val[0] = rgb.val[0];
+        rgba.val[1] = rgb.val[1];
+        rgba.val[2] = rgb.val[2];
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8((uint8_t*) dst, rgba);
+
+        src += 48;
+        dst += 16;
+    }
+
+    RGBToRGBAScalar(src, dst, count - ii);
+}
+
+ST_NEON_TARGET static void
+GrayToRGBANEON(const unsigned char* src, STColor4ub* dst, int count)
+{
+    int ii = 0;
+    for (; ii + 16 <= count; ii += 16) {
+        uint8x16_t g = vld1q_u8(src);
+        uint8x16x4_t rgba;
+        rgba.val[0] = g;
+        rgba.val[1] = g;
+        rgba.val[2] = g;
+        rgba.val[3] = vdupq_n_u8(255);
+        vst4q_u8((uint8_t*) dst, rgba);
+
+        src += 16;
+        dst += 16;
+    }
+
+    GrayToRGBAScalar(src, dst, count - ii);
+}
+
+static bool
+HaveNEON()
+{
+#if defined(__linux__) && !defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return true;
+#endif
+}
+
+#endif // ST_PIXEL_NEON
+
+//
+// The kernels in use, chosen once when the library is loaded (before any
+// loader thread can run).
+//
+struct STPixelKernels
+{
+    ConvertFunc rgbToRGBA;
+    ConvertFunc grayToRGBA;
+    const char* name;
+};
+
+static STPixelKernels
+SelectKernels()
+{
+    STPixelKernels kernels;
+    kernels.rgbToRGBA = RGBToRGBAScalar;
+    kernels.grayToRGBA = GrayToRGBAScalar;
+    kernels.name = "scalar";
+
+#ifdef ST_PIXEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.grayToRGBA = GrayToRGBASSE2;
+        kernels.name = "sse2";
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels.rgbToRGBA = RGBToRGBASSSE3;
+        kernels.name = "ssse3";
+    }
+#endif
+
+#ifdef ST_PIXEL_NEON
+    if (HaveNEON()) {
+        kernels.rgbToRGBA = RGBToRGBANEON;
+        kernels.grayToRGBA = GrayToRGBANEON;
+        kernels.name = "neon";
+    }
+#endif
+
+    return kernels;
+}
+
+static const STPixelKernels sKernels = SelectKernels();
+
+void
+STConvertRGBToRGBA(const unsigned char* src, STColor4ub* dst, int count)
+{
+    sKernels.rgbToRGBA(src, dst, count);
+}
+
+void
+STConvertGrayToRGBA(const unsigned char* src, STColor4ub* dst, int count)
+{
+    sKernels.grayToRGBA(src, dst, count);
+}
+
+//
+// Swaps rows pairwise from the outside in through one row of scratch
+// space. This is bound by memory bandwidth, and memcpy is already
+// vectorized by the C library, so there is no separate SIMD version.
+//
+void
+STFlipRows(void* rows, int rowBytes, int numRows)
+{
+    if (numRows < 2 || rowBytes <= 0)
+        return;
+
+    std::vector<unsigned char> scratch(rowBytes);
+    unsigned char* top = (unsigned char*) rows;
+    unsigned char* bottom = top + (size_t) (numRows - 1) * rowBytes;
+
+    while (top < bottom) {
+        memcpy(&scratch[0], top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, &scratch[0], rowBytes);
+        top += rowBytes;
+        bottom -= rowBytes;
+    }
+}
+
+//
+// The blocks are a whole number of source pixels: when halving an odd
+// size, the last block is three pixels wide instead of two. Generating a
+// mipmap level is the common case, where every block is 2x2 or close.
+//
+void
+STBoxDownsample(const STColor4ub* src, int srcWidth, int srcHeight,
+                STColor4ub* dst, int dstWidth, int dstHeight)
+{
+    if (dstWidth <= 0 || dstHeight <= 0)
+        return;
+
+    std::vector<int> xStart(dstWidth + 1);
+    for (int x = 0; x <= dstWidth; ++x)
+        xStart[x] = (int) ((long long) x * srcWidth / dstWidth);
+
+    for (int y = 0; y < dstHeight; ++y) {
+        int y0 = (int) ((long long) y * srcHeight / dstHeight);
+        int y1 = (int) ((long long) (y + 1) * srcHeight / dstHeight);
+
+        for (int x = 0; x < dstWidth; ++x) {
+            int x0 = xStart[x];
+            int x1 = xStart[x + 1];
+
+            unsigned int r = 0, g = 0, b = 0, a = 0;
+            for (int sy = y0; sy < y1; ++sy) {
+                const STColor4ub* p = src + (size_t) sy * srcWidth + x0;
+                for (int sx = x0; sx < x1; ++sx, ++p) {
+                    r += p->r;
+                    g += p->g;
+                    b += p->b;
+                    a += p->a;
+                }
+            }
+
+            unsigned int n = (unsigned int) ((x1 - x0) * (y1 - y0));
+            STColor4ub* d = dst + (size_t) y * dstWidth + x;
+            d->r = (unsigned char) ((r + n / 2) / n);
+            d->g = (unsigned char) ((g + n / 2) / n);
+            d->b = (unsigned char) ((b + n / 2) / n);
+            d->a = (unsigned char) ((a + n / 2) / n);
+        }
+    }
+}
+
+const char*
+STPixelConvertKernels()
+{
+    return sKernels.name;
+}
@@ -3,6 +3,14 @@
 
 #include "st.h"
 #include "stgl.h"
+#include "STPixelConvert.h"
+
+#include <string.h>
+#include <vector>
+
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
 
 //
 
@@ -12,6 +20,8 @@
 STTexture::STTexture()
     : mWidth(-1)
     , mHeight(-1)
+    , mHasMipmaps(false)
+    , mIsCompressed(false)
 {
     Initialize();
 }
@@ -24,11 +34,24 @@ STTexture::STTexture(
     ImageOptions options)
     : mWidth(-1)
     , mHeight(-1)
+    , mHasMipmaps(false)
+    , mIsCompressed(false)
 {
     Initialize();
     LoadImageData(image, options);
 }
 
+// Create a new STTexture from a compressed image.
+STTexture::STTexture(const STCompressedImage* image)
+    : mWidth(-1)
+    , mHeight(-1)
+    , mHasMipmaps(false)
+    , mIsCompressed(false)
+{
+    Initialize();
+    LoadCompressedData(image);
+}
+
 // Common initialization code, used by all constructors.
 void STTexture::Initialize()
 {
@@ -47,6 +70,49 @@ STTexture::~STTexture()
     glDeleteTextures(1, &mTexId);
 }
 
+static bool
+IsPowerOfTwo(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// Whether the GL lists an extension. Needs a current context.
+static bool
+HaveExtension(const char* name)
+{
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    return extensions != NULL && strstr(extensions, name) != NULL;
+}
+
+// Whether the GL can mipmap textures whose sizes aren't powers of two.
+// Needs a current context; the answer is looked up once.
+static bool
+HaveNPOTMipmaps()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = HaveExtension("GL_OES_texture_npot");
+    return supported != 0;
+}
+
+// Whether the GL can take ETC1 textures; looked up once.
+bool STTexture::SupportsETC1()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = HaveExtension("GL_OES_compressed_ETC1_RGB8_texture");
+    return supported != 0;
+}
+
+// The GL's largest texture size; looked up once.
+int STTexture::MaxSize()
+{
+    static GLint maxSize = 0;
+    if (maxSize <= 0)
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    return maxSize;
+}
+
 // Load image data into the STTexture. The texture will be
 // resized to match the image as needed. Use the options
 // to specify whether mip maps should be generated.
@@ -61,9 +127,213 @@ void STTexture::LoadImageData(const STImage* image,
     mHeight = height;
     const STColor4ub* pixels = image->GetPixels();
 
+    mHasMipmaps = (options & kGenerateMipmaps) != 0;
+    mIsCompressed = false;
+
+    if (mHasMipmaps && !(IsPowerOfTwo(width) && IsPowerOfTwo(height))) {
+        UploadMipmapsCPU(pixels, width, height);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                     width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        if (mHasMipmaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    // Without mipmaps, a mipmapping minification filter would leave
+    // the texture incomplete.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    mHasMipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    UnBind();
+}
+
+// Each level is half the size of the one above it, rounded down, and box
+// filtered from it. Without NPOT mipmap support, level 0 is itself box
+// filtered down to the largest power of two size that fits, and that
+// becomes the texture's size; texture coordinates are normalized, so
+// drawing is unaffected.
+void STTexture::UploadMipmapsCPU(const STColor4ub* pixels,
+                                 int width, int height)
+{
+    std::vector<STColor4ub> level, next;
+
+    if (!HaveNPOTMipmaps()) {
+        int potWidth = 1, potHeight = 1;
+        while (potWidth * 2 <= width)
+            potWidth *= 2;
+        while (potHeight * 2 <= height)
+            potHeight *= 2;
+
+        level.resize((size_t) potWidth * potHeight);
+        STBoxDownsample(pixels, width, height,
+                        &level[0], potWidth, potHeight);
+        pixels = &level[0];
+        width = potWidth;
+        height = potHeight;
+        mWidth = width;
+        mHeight = height;
+    }
+
+    for (int lod = 0; ; ++lod) {
+        glTexImage2D(GL_TEXTURE_2D, lod, GL_RGBA,
+                     width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+        if (width == 1 && height == 1)
+            break;
+
+        int nextWidth = width > 1 ? width / 2 : 1;
+        int nextHeight = height > 1 ? height / 2 : 1;
+        next.resize((size_t) nextWidth * nextHeight);
+        STBoxDownsample(pixels, width, height,
+                        &next[0], nextWidth, nextHeight);
+
+        level.swap(next);
+        pixels = &level[0];
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
+
+// Load compressed image data into the STTexture, decoding it
+// first if the GL can't take it.
+void STTexture::LoadCompressedData(const STCompressedImage* image)
+{
+    if (!SupportsETC1()) {
+        STImage decoded(image->GetWidth(), image->GetHeight());
+        image->Decode(decoded.GetPixels());
+        LoadImageData(&decoded, kNone);
+        return;
+    }
+
+    Bind();
+
+    mWidth = image->GetWidth();
+    mHeight = image->GetHeight();
+    mHasMipmaps = false;
+    mIsCompressed = true;
+
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES,
+                           mWidth, mHeight, 0,
+                           (GLsizei) image->GetDataSize(), image->GetData());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    UnBind();
+}
+
+// Resize the texture to width x height pixels without giving
+// it any image data. The texture has no mipmaps.
+void STTexture::Allocate(int width, int height)
+{
+    Bind();
+
+    mWidth = width;
+    mHeight = height;
+    mHasMipmaps = false;
+    mIsCompressed = false;
+
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
                  width, height, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    UnBind();
+}
+
+// Upload transparent pixels over the whole texture from a buffer
+// of a few rows, reused for every band.
+void STTexture::Clear()
+{
+    if (mWidth <= 0 || mHeight <= 0)
+        return;
+
+    const int kBandPixels = 16384;
+    int rows = kBandPixels / mWidth;
+    if (rows < 1)
+        rows = 1;
+    if (rows > mHeight)
+        rows = mHeight;
+
+    std::vector<STColor4ub> band((size_t) mWidth * rows,
+                                 STColor4ub(0, 0, 0, 0));
+    for (int y = 0; y < mHeight; y += rows)
+        UpdateImageData(0, y, mWidth, rows, &band[0]);
+}
+
+// Replace the pixels in the rectangle at (x, y) the size of the
+// image with the image's pixels.
+void STTexture::LoadImageSubData(const STImage* image, int x, int y)
+{
+    Bind();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y,
+                    image->GetWidth(), image->GetHeight(),
+                    GL_RGBA, GL_UNSIGNED_BYTE, image->GetPixels());
+    UnBind();
+}
+
+// Make the texture a copy of a rectangle of another texture, by
+// attaching that one to a framebuffer object and copying from it.
+bool STTexture::CopyTextureData(const STTexture* source,
+                                int x, int y, int width, int height)
+{
+    GLint oldFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFramebuffer);
+
+    GLuint framebuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, source->mTexId, 0);
+    bool copied = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+        GL_FRAMEBUFFER_COMPLETE;
+
+    if (copied) {
+        Bind();
+        mWidth = width;
+        mHeight = height;
+        mHasMipmaps = false;
+        mIsCompressed = false;
+        glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y, width, height, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        UnBind();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, oldFramebuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    if (!copied) {
+        STImage transparent(width, height);
+        LoadImageData(&transparent, kNone);
+    }
+
+    return copied;
+}
+
+// Upload the pixels of a rectangle, clipped to the texture. A
+// rectangle inside the texture goes in one glTexSubImage2D; GLES has
+// no GL_UNPACK_ROW_LENGTH, so a clipped one goes a row at a time.
+void STTexture::UpdateImageData(int x, int y, int width, int height,
+                                const STColor4ub* pixels)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + width > mWidth ? mWidth : x + width;
+    int y1 = y + height > mHeight ? mHeight : y + height;
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    Bind();
+    if (x0 == x && x1 == x + width) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0,
+                        GL_RGBA, GL_UNSIGNED_BYTE,
+                        pixels + (size_t) (y0 - y) * width);
+    }
+    else {
+        for (int row = y0; row < y1; ++row) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x0, row, x1 - x0, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE,
+                            pixels + (size_t) (row - y) * width + (x0 - x));
+        }
+    }
     UnBind();
 }
 
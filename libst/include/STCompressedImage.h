@@ -0,0 +1,107 @@
+// STCompressedImage.h
+#ifndef __STCOMPRESSEDIMAGE_H__
+#define __STCOMPRESSEDIMAGE_H__
+
+#include "STColor4ub.h"
+#include "STUtil.h" // for STStatus
+
+#include <string>
+#include <vector>
+
+class STImage;
+
+/**
+* The STCompressedImage class holds an image in a block compressed GPU
+* texture format, ready to be handed to OpenGL as is by an STTexture.
+* The only format so far is ETC1: opaque RGB in 4x4 pixel blocks of 8
+* bytes, a sixth of the size of the same pixels in an STImage.
+*
+* Compressed images are read from and written to PKM files:
+*
+*   STCompressedImage* sky = new STCompressedImage("./sky.pkm");
+*
+* or compressed from an STImage (its alpha channel is dropped):
+*
+*   STCompressedImage sky(image);
+*   sky.Save("./sky.pkm");
+*
+* PKM files hold the blocks top row first, as other tools write them.
+* In memory, like the pixels of an STImage, they are bottom row first,
+* which is the order OpenGL expects; loading and saving flip them.
+*
+* Decode() expands the blocks back to RGBA in software, for GLs
+* without ETC1 support; STImage uses it to load .pkm files too.
+*/
+class STCompressedImage
+{
+public:
+    //
+    // Block compressed formats.
+    //
+    enum Format {
+        kETC1,
+    };
+
+    //
+    // Load a compressed image from a PKM file.
+    // Throws std::runtime_error on failure.
+    //
+    STCompressedImage(const std::string& filename);
+
+    //
+    // Compress the pixels of an image to ETC1.
+    //
+    STCompressedImage(const STImage* image);
+
+    //
+    // Write the compressed image to a PKM file.
+    // Returns a non-zero value on error.
+    //
+    STStatus Save(const std::string& filename) const;
+
+    //
+    // Expand the image to GetWidth()*GetHeight() RGBA pixels, stored
+    // bottom row first like those of an STImage.
+    //
+    void Decode(STColor4ub* pixels) const;
+
+    //
+    // Get the format of the compressed data.
+    //
+    Format GetFormat() const { return mFormat; }
+
+    //
+    // Get the width (in pixels) of the image.
+    //
+    int GetWidth() const { return mWidth; }
+
+    //
+    // Get the height (in pixels) of the image.
+    //
+    int GetHeight() const { return mHeight; }
+
+    //
+    // Get read-only access to the compressed blocks: rows of
+    // (width+3)/4 blocks, (height+3)/4 rows, bottom row first.
+    //
+    const unsigned char* GetData() const { return &mData[0]; }
+
+    //
+    // Get the size (in bytes) of the compressed blocks.
+    //
+    size_t GetDataSize() const { return mData.size(); }
+
+    //
+    // Whether filename names a file in a compressed format (by its
+    // extension).
+    //
+    static bool IsCompressedFile(const std::string& filename);
+
+private:
+    Format mFormat;
+    int mWidth;
+    int mHeight;
+    std::vector<unsigned char> mData;
+};
+
+#endif // __STCOMPRESSEDIMAGE_H__
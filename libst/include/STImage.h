@@ -34,6 +34,14 @@
 * Any image can be written to a file by using Save():
 *
 *   red->Save("./output.ppm");
+*
+* Besides PPM (P3, P5 and P6), PNG and JPEG, STImage reads and writes
+* its own raw format (extension .rgba): a 16 byte header followed by
+* the pixels exactly as STImage stores them, so loading one is a
+* memory map of the file with no decoding or copying at all.
+*
+* ETC1 compressed PKM files (see STCompressedImage) are decoded in
+* software when loaded, and compressed when saved.
 */
 
 class STImage
@@ -49,7 +57,19 @@ public:
     // and PNG formats are supported).
     // Returns NULL on failure.
     //
-    STImage(const std::string& filename);
+    // If a target size is given, the loader may produce a smaller
+    // image than the file holds, as long as it is at least
+    // targetWidth x targetHeight (JPEGs are decoded at 1/2, 1/4 or
+    // 1/8 scale when that is enough).
+    //
+    STImage(const std::string& filename,
+            int targetWidth = 0, int targetHeight = 0);
+
+    //
+    // Whether loading the file can make use of a target size, i.e.
+    // whether its format is decoded at reduced scale (JPEG).
+    //
+    static bool DecodesScaled(const std::string& filename);
 
     //
     // Construct a new image of the specified width and height,
@@ -130,6 +150,11 @@ private:
     // left-to-right, bottom-to-top order.
     Pixel* mPixels;
 
+    // The memory mapped file mPixels points into, for images loaded
+    // from raw files, or NULL if mPixels was allocated.
+    void* mMapping;
+    size_t mMappingSize;
+
     //
     void Initialize(int width, int height);
 
@@ -143,8 +168,16 @@ private:
     void LoadPNG(const std::string& filename);
     STStatus  SavePNG(const std::string& filename) const;
 
-    void LoadJPG(const std::string& filename);
+    void LoadJPG(const std::string& filename,
+                 int targetWidth, int targetHeight);
     STStatus  SaveJPG(const std::string& filename) const;
+
+    void LoadRaw(const std::string& filename);
+    STStatus  SaveRaw(const std::string& filename) const;
+    void UnmapRaw();
+
+    void LoadPKM(const std::string& filename);
+    STStatus  SavePKM(const std::string& filename) const;
 };
 
 #endif // __STIMAGE_H__
@@ -0,0 +1,43 @@
+// STPixelConvert.h
+#ifndef __STPIXELCONVERT_H__
+#define __STPIXELCONVERT_H__
+
+/* Pixel format conversion kernels shared by the STImage loaders and
+ * STTexture.
+ *
+ * Each kernel has a scalar version plus SIMD versions (SSE2/SSSE3 on
+ * x86, NEON on ARM) where the compiler supports them. The fastest one the
+ * CPU running the program supports is picked on first use.
+ */
+
+#include "STColor4ub.h"
+
+//
+// Expand count packed 8 bit RGB pixels from src to opaque RGBA in dst.
+//
+void STConvertRGBToRGBA(const unsigned char* src, STColor4ub* dst, int count);
+
+//
+// Expand count 8 bit greyscale pixels from src to opaque RGBA in dst.
+//
+void STConvertGrayToRGBA(const unsigned char* src, STColor4ub* dst, int count);
+
+//
+// Reverse the order of numRows rows of rowBytes bytes each, in place.
+//
+void STFlipRows(void* rows, int rowBytes, int numRows);
+
+//
+// Shrink a srcWidth x srcHeight image into dst, which is dstWidth x
+// dstHeight and no bigger, by averaging the block of source pixels that
+// falls into each destination pixel (a box filter).
+//
+void STBoxDownsample(const STColor4ub* src, int srcWidth, int srcHeight,
+                     STColor4ub* dst, int dstWidth, int dstHeight);
+
+//
+// Name of the kernel set in use ("scalar", "sse2", "ssse3" or "neon").
+//
+const char* STPixelConvertKernels();
+
+#endif // __STPIXELCONVERT_H__
@@ -4,6 +4,7 @@
 
 #include "stgl.h"
 #include "STImage.h"
+#include "STCompressedImage.h"
 
 /**
 * The STTexture class allows use of an STImage as an OpenGL texture.
@@ -23,6 +24,19 @@
 *   // do OpenGL rendering
 *   texture->UnBind();
 *
+* Parts of a texture can be replaced without reallocating it, e.g. to
+* stream video into it. UpdateImageData() uploads the pixels of a
+* rectangle straight from wherever the caller keeps them, so frames can
+* be staged in one reused buffer and never copied again:
+*
+*   texture->UpdateImageData(x, y, width, height, pixels);
+*
+* A texture can also be made from an ETC1 STCompressedImage, which is
+* handed to OpenGL without being decoded when the GL supports ETC1
+* (see SupportsETC1()), and decoded in software otherwise:
+*
+*   STTexture* texture = new STTexture(compressedImage);
+*
 * You must remember not to create any STTextures until you have
 * initialized OpenGL.
 */
@@ -31,9 +45,13 @@ class STTexture
 public:
     //
     // Options when loading an image to an STTexture. Use the
-    // kGenerateMipmaps option to use OpenGL to generate mipmaps -
-    // downsampled images used to improve the quality of texture
-    // filtering.
+    // kGenerateMipmaps option to generate mipmaps - downsampled
+    // images used to improve the quality of texture filtering.
+    // OpenGL generates them for power of two sized images; for
+    // other sizes they are box filtered on the CPU, and where the
+    // GL can't mipmap such textures at all (OpenGL ES 2 without
+    // GL_OES_texture_npot) the image is first shrunk to the power
+    // of two size below it.
     //
     enum ImageOptions {
         kNone = 0,
@@ -48,6 +66,12 @@ public:
     STTexture(const STImage* image,
               ImageOptions options = kGenerateMipmaps);
 
+    //
+    // Create a new STTexture from a compressed image. Compressed
+    // textures have no mipmaps.
+    //
+    STTexture(const STCompressedImage* image);
+
     //
     // Create an "empty" STTexture with no image data. You will need
     // to load an image before you can use this texture for
@@ -68,6 +92,63 @@ public:
     void LoadImageData(const STImage* image,
                        ImageOptions options = kGenerateMipmaps);
 
+    //
+    // Load compressed image data into the STTexture, as it is if
+    // the GL supports the format and decoded to RGBA if not.
+    //
+    void LoadCompressedData(const STCompressedImage* image);
+
+    //
+    // Whether the GL can take ETC1 textures
+    // (GL_OES_compressed_ETC1_RGB8_texture). Needs a current
+    // OpenGL context.
+    //
+    static bool SupportsETC1();
+
+    //
+    // The largest width or height the GL takes for a texture
+    // (GL_MAX_TEXTURE_SIZE). Needs a current OpenGL context.
+    //
+    static int MaxSize();
+
+    //
+    // Resize the texture to width x height pixels without giving
+    // it any image data, to be filled in piece by piece with
+    // LoadImageSubData(). The texture has no mipmaps.
+    //
+    void Allocate(int width, int height);
+
+    //
+    // Make every pixel of the texture transparent black, a band of
+    // rows at a time, without an image the size of the texture.
+    //
+    void Clear();
+
+    //
+    // Replace the pixels of the texture in the rectangle whose
+    // bottom-left corner is at (x, y) and whose size is that of
+    // the image. The rectangle must lie inside the texture.
+    //
+    void LoadImageSubData(const STImage* image, int x, int y);
+
+    //
+    // Make the texture a width x height copy of the rectangle at
+    // (x, y) of another texture, drawing from it through a
+    // framebuffer object. Returns false, leaving the texture
+    // transparent, if the GL can't do that (e.g. for compressed
+    // textures).
+    //
+    bool CopyTextureData(const STTexture* source,
+                         int x, int y, int width, int height);
+
+    //
+    // Replace the rectangle whose bottom-left corner is at (x, y)
+    // with width*height pixels (bottom row first), clipped to the
+    // texture.
+    //
+    void UpdateImageData(int x, int y, int width, int height,
+                         const STColor4ub* pixels);
+
     //
     // Bind this texture for use in subsequent OpenGL drawing.
     //
@@ -96,25 +177,45 @@ public:
     void SetWrap(GLint wrapS, GLint wrapT);
 
     //
-    // Get the width (in pixels) of the image.
+    // Get the width (in pixels) of the texture's top level. A
+    // mipmapped image whose size isn't a power of two is shrunk
+    // to one when the GL can't mipmap it otherwise, so this may
+    // be less than the image's width.
     //
     int GetWidth() const { return mWidth; }
 
     //
-    // Get the height (in pixels) of the image.
+    // Get the height (in pixels) of the texture's top level.
     //
     int GetHeight() const { return mHeight; }
 
+    //
+    // Whether the texture has mipmaps.
+    //
+    bool HasMipmaps() const { return mHasMipmaps; }
+
+    //
+    // Whether the GL holds the texture in a compressed format.
+    //
+    bool IsCompressed() const { return mIsCompressed; }
+
 private:
     // Common initialization code, used by all constructors.
     void Initialize();
 
+    // Build and upload every mipmap level from the pixels on the CPU.
+    void UploadMipmapsCPU(const STColor4ub* pixels,
+                          int width, int height);
+
     // The OpenGL texture id.
     GLuint mTexId;
 
-    // The width and height of the image data.
+    // The width and height of the top level, as uploaded.
     int mWidth;
     int mHeight;
+
+    bool mHasMipmaps;
+    bool mIsCompressed;
 };
 
 #endif // __STTEXTURE_H__
@@ -0,0 +1,138 @@
+// etc1convert.cpp
+//
+// Compresses images to ETC1 PKM files for STCompressedImage/STTexture.
+//
+//   usage: etc1convert [-f] file-or-directory...
+//
+// Every PNG, JPEG and PPM file named, or found anywhere under a directory
+// named, is written next to itself with its extension replaced by .pkm.
+// Files whose .pkm is already newer are skipped unless -f is given.
+//
+#include "STImage.h"
+#include "STCompressedImage.h"
+#include "st.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+
+static bool sForce = false;
+static int sNumConverted = 0;
+static int sNumFailed = 0;
+
+static bool
+IsSourceImage(const std::string& filename)
+{
+    std::string ext = STGetExtension(filename);
+    return ext.compare("PNG") == 0 || ext.compare("JPG") == 0 ||
+        ext.compare("JPEG") == 0 || ext.compare("PPM") == 0;
+}
+
+static std::string
+PKMName(const std::string& filename)
+{
+    size_t dot = filename.find_last_of(".");
+    return filename.substr(0, dot) + ".pkm";
+}
+
+static void
+Convert(const std::string& filename)
+{
+    std::string output = PKMName(filename);
+
+    struct stat in, out;
+    if (!sForce && stat(filename.c_str(), &in) == 0 &&
+        stat(output.c_str(), &out) == 0 && out.st_mtime >= in.st_mtime)
+        return;
+
+    try {
+        STImage image(filename);
+
+        const STImage::Pixel* pixels = image.GetPixels();
+        size_t numPixels = (size_t) image.GetWidth() * image.GetHeight();
+        for (size_t ii = 0; ii < numPixels; ++ii) {
+            if (pixels[ii].a != 255) {
+                fprintf(stderr, "etc1convert: %s: warning: transparency "
+                        "is lost, ETC1 has no alpha\n", filename.c_str());
+                break;
+            }
+        }
+
+        STCompressedImage compressed(&image);
+        if (compressed.Save(output) != ST_OK) {
+            sNumFailed++;
+            return;
+        }
+
+        printf("%s -> %s (%lu -> %lu bytes)\n", filename.c_str(),
+               output.c_str(), (unsigned long) (numPixels * 4),
+               (unsigned long) compressed.GetDataSize());
+        sNumConverted++;
+    }
+    catch (std::runtime_error&) {
+        sNumFailed++;
+    }
+    catch (std::runtime_error* e) {
+        delete e;
+        sNumFailed++;
+    }
+}
+
+static void
+ConvertPath(const std::string& path, bool named)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        fprintf(stderr, "etc1convert: can't find '%s'\n", path.c_str());
+        sNumFailed++;
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        // files found in directories must look like images; files named
+        // on the command line are tried whatever they are called
+        if (named || IsSourceImage(path))
+            Convert(path);
+        return;
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        fprintf(stderr, "etc1convert: can't read '%s'\n", path.c_str());
+        sNumFailed++;
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        ConvertPath(path + "/" + entry->d_name, false);
+    }
+
+    closedir(dir);
+}
+
+int
+main(int argc, char** argv)
+{
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+        sForce = true;
+        first = 2;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "usage: etc1convert [-f] file-or-directory...\n");
+        return 1;
+    }
+
+    for (int ii = first; ii < argc; ++ii)
+        ConvertPath(argv[ii], true);
+
+    printf("etc1convert: %d converted, %d failed\n",
+           sNumConverted, sNumFailed);
+    return sNumFailed == 0 ? 0 : 1;
+}
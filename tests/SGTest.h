@@ -0,0 +1,43 @@
+/*******************************************************************************
+
+ SGTest
+
+ Notes: The little there is of a test framework for the tests in this
+ directory. Each test is its own program: SG_CHECK() reports a failed
+ condition with its file and line and carries on, and sgTestResult() prints
+ a summary and gives the exit status for main() to return.
+
+ ******************************************************************************/
+
+
+#ifndef __SG_TEST_H__
+#define __SG_TEST_H__
+
+
+#include <stdio.h>
+
+
+static int g_numChecks = 0, g_numFailed = 0;
+
+#define SG_CHECK(cond) sgCheck((cond), #cond, __FILE__, __LINE__)
+
+static inline bool sgCheck(bool ok, const char *cond, const char *file, int line)
+{
+    g_numChecks++;
+    if(!ok)
+    {
+        g_numFailed++;
+        printf("%s(%d): FAILED: %s\n", file, line, cond);
+    }
+    return ok;
+}
+
+// print the summary for the test named name; returns main()'s exit status
+static inline int sgTestResult(const char *name)
+{
+    printf("%s: %d checks, %d failed\n", name, g_numChecks, g_numFailed);
+    return g_numFailed == 0 ? 0 : 1;
+}
+
+
+#endif // __SG_TEST_H__
@@ -0,0 +1,264 @@
+// test_alloc.cpp
+//
+// Nothing on the way from an OSC packet to an applied SGMessage allocates
+// once the ids and addresses have been seen: parsing the packet, looking up
+// its address, interning its id, staging its pixels and queueing it on the
+// OSC thread side; taking whole transactions off the queue, scheduling and
+// coalescing them on the render thread side.
+//
+// The decoding below follows ExamplePacketListener, which can't be built
+// here without GL.
+
+#include "SGTest.h"
+
+#include <new>
+#include <stdlib.h>
+
+// count every allocation made while g_counting is set
+static size_t g_numAllocations = 0;
+static bool g_counting = false;
+
+void *operator new(size_t size)
+{
+    if(g_counting)
+        g_numAllocations++;
+    void *p = malloc(size > 0 ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+
+#include "SGMessageQueue.h"
+#include "SGPixelRing.h"
+#include "SGCoalescer.h"
+#include "SGScheduler.h"
+#include "SGOscDispatcher.h"
+#include "SGIdTable.h"
+#include "SGPattern.h"
+
+#include "osc/OscPacketListener.h"
+#include "osc/OscOutboundPacketStream.h"
+#include "ip/IpEndpointName.h"
+
+#include <vector>
+#include <string.h>
+
+
+class Listener : public osc::OscPacketListener
+{
+public:
+
+    Listener(SGMessageQueue &queue, SGPixelRing &ring) :
+    m_queue(queue),
+    m_ring(ring),
+    m_timeTag(SGScheduler::IMMEDIATELY)
+    {
+        m_types.add("/sg/rect", SGMessage::RECT);
+        m_types.add("/sg/position", SGMessage::POSITION);
+        m_types.add("/sg/color", SGMessage::COLOR);
+        m_types.add("/sg/alpha", SGMessage::ALPHA);
+        m_types.add("/sg/subimage", SGMessage::SUBIMAGE);
+        m_types.add("/sg/remove", SGMessage::REMOVE);
+    }
+
+    virtual void ProcessPacket(const char *data, int size,
+        const IpEndpointName &remoteEndpoint)
+    {
+        m_queue.begin();
+        osc::OscPacketListener::ProcessPacket(data, size, remoteEndpoint);
+        m_queue.commit();
+    }
+
+protected:
+
+    virtual void ProcessBundle(const osc::ReceivedBundle &b,
+        const IpEndpointName &remoteEndpoint)
+    {
+        SGScheduler::TimeTag outer = m_timeTag;
+        m_timeTag = b.TimeTag();
+        osc::OscPacketListener::ProcessBundle(b, remoteEndpoint);
+        m_timeTag = outer;
+    }
+
+    virtual void ProcessMessage(const osc::ReceivedMessage &m,
+        const IpEndpointName &)
+    {
+        const SGMessage::Type *type = m_types.find(m.AddressPattern());
+        if(type == NULL)
+            return;
+
+        SGMessage msg = SGMessage();
+        msg.type = *type;
+        msg.timeTag = m_timeTag;
+
+        osc::ReceivedMessageArgumentIterator i = m.ArgumentsBegin();
+        const char *id = (i++)->AsString();
+        if(SGPattern::isPattern(id))
+        {
+            msg.handle = SGMessage::PATTERN_HANDLE;
+            msg.objectId = m_patterns.name(m_patterns.intern(id));
+        }
+        else
+        {
+            msg.handle = m_ids.intern(id);
+            msg.objectId = m_ids.name(msg.handle);
+        }
+
+        switch(msg.type)
+        {
+            case SGMessage::SUBIMAGE:
+            {
+                msg.position.x = (i++)->AsFloat();
+                msg.position.y = (i++)->AsFloat();
+                msg.size.x = (i++)->AsFloat();
+                msg.size.y = (i++)->AsFloat();
+
+                const void *data;
+                unsigned long dataSize;
+                (i++)->AsBlob(data, dataSize);
+                unsigned char *out = m_ring.reserve(dataSize, msg.pixels);
+                if(out == NULL)
+                    return;
+                memcpy(out, data, dataSize);
+                m_ring.commit(msg.pixels, dataSize);
+            }
+            break;
+
+            case SGMessage::REMOVE:
+            break;
+
+            default:
+                msg.position.x = (i++)->AsFloat();
+                msg.position.y = (i++)->AsFloat();
+                msg.color.r = (i++)->AsFloat();
+                msg.color.a = (i++)->AsFloat();
+            break;
+        }
+
+        m_queue.put(msg);
+    }
+
+private:
+
+    SGMessageQueue &m_queue;
+    SGPixelRing &m_ring;
+    SGOscDispatcher<SGMessage::Type> m_types;
+    SGIdTable m_ids;
+    SGIdTable m_patterns;
+    SGScheduler::TimeTag m_timeTag;
+};
+
+
+static void addPacket(std::vector<std::vector<char> > &packets,
+    osc::OutboundPacketStream &p)
+{
+    packets.push_back(std::vector<char>(p.Data(), p.Data() + p.Size()));
+}
+
+int main()
+{
+    SGMessageQueue queue(256, SGMessageQueue::COALESCE);
+    SGPixelRing ring(1 << 16);
+    Listener listener(queue, ring);
+
+    // one of everything the listener decodes, lone and in bundles
+    std::vector<std::vector<char> > packets;
+    char buffer[4096];
+    unsigned char pixels[8*8*4] = { 0 };
+    {
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginMessage("/sg/rect") << "box" << 0.f << 0.f << 1.f << 1.f
+            << osc::EndMessage;
+        addPacket(packets, p);
+    }
+    {
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginBundleImmediate;
+        for(int k = 0; k < 20; k++)
+        {
+            p << osc::BeginMessage("/sg/position") << (k % 2 ? "box" : "ball")
+                << (float) k << 0.f << 1.f << 1.f << osc::EndMessage;
+        }
+        p << osc::BeginMessage("/sg/alpha") << "b*" << 0.f << 0.f << 0.f << 0.5f
+            << osc::EndMessage;
+        p << osc::EndBundle;
+        addPacket(packets, p);
+    }
+    {
+        // due now: goes through the scheduler's heap and straight out
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginBundle(SGScheduler::now())
+            << osc::BeginMessage("/sg/color") << "ball" << 0.f << 0.f << 1.f << 1.f
+            << osc::EndMessage
+            << osc::BeginMessage("/sg/color") << "box" << 0.f << 0.f << 1.f << 1.f
+            << osc::EndMessage
+            << osc::EndBundle;
+        addPacket(packets, p);
+    }
+    {
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginMessage("/sg/subimage") << "box" << 0.f << 0.f << 8.f << 8.f
+            << osc::Blob(pixels, sizeof pixels) << osc::EndMessage;
+        addPacket(packets, p);
+    }
+    {
+        osc::OutboundPacketStream p(buffer, sizeof buffer);
+        p << osc::BeginMessage("/sg/remove") << "ball" << osc::EndMessage;
+        addPacket(packets, p);
+    }
+
+    std::vector<SGMessage> frameMsgs(1), newMsgs;
+    std::vector<bool> skip;
+    SGCoalescer coalescer;
+    SGScheduler scheduler;
+    size_t numMsgs = 0;
+
+    const int NUM_ROUNDS = 2000;
+    for(int round = 0; round < NUM_ROUNDS; round++)
+    {
+        // the first round interns the ids and sizes the vectors
+        g_counting = round > 0;
+
+        for(size_t k = 0; k < packets.size(); k++)
+            listener.ProcessPacket(&packets[k][0], (int) packets[k].size(),
+                IpEndpointName());
+
+        // one render frame
+        size_t numFrame = scheduler.release(SGScheduler::now(), frameMsgs);
+        size_t numNew = queue.getTransactions(newMsgs);
+        if(frameMsgs.size() < numFrame + numNew)
+            frameMsgs.resize(numFrame + numNew);
+        for(size_t m = 0; m < numNew; m++)
+        {
+            if(scheduler.arrive(newMsgs[m]))
+                frameMsgs[numFrame++] = newMsgs[m];
+        }
+        coalescer.coalesce(&frameMsgs[0], numFrame, skip);
+        for(size_t m = 0; m < numFrame; m++)
+        {
+            if(frameMsgs[m].type == SGMessage::SUBIMAGE)
+                ring.release(frameMsgs[m].pixelsEnd());
+        }
+
+        numMsgs += numFrame;
+    }
+    g_counting = false;
+
+    // everything went through, nothing dropped, and nothing allocated
+    SG_CHECK(numMsgs == NUM_ROUNDS * (1 + 21 + 2 + 1 + 1));
+    SG_CHECK(queue.numDropped() == 0);
+    SG_CHECK(ring.numDropped() == 0);
+    SG_CHECK(g_numAllocations == 0);
+    if(g_numAllocations != 0)
+        printf("%lu allocations\n", (unsigned long) g_numAllocations);
+
+    return sgTestResult("test_alloc");
+}
@@ -0,0 +1,210 @@
+// test_lockfreebuffer.cpp
+//
+// LockFreeBuffer and SGPixelRing: the single-threaded contract, then a
+// producer and a consumer thread hammering each one and checking that
+// everything comes out whole and in order.
+
+#include "SGTest.h"
+#include "LockFreeBuffer.h"
+#include "SGPixelRing.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+
+// elements wider than a word, so a torn read shows up as a mismatch
+struct Record
+{
+    size_t seq;
+    size_t a, b, c;
+};
+
+static Record makeRecord(size_t seq)
+{
+    Record r;
+    r.seq = seq;
+    r.a = seq * 3;
+    r.b = ~seq;
+    r.c = seq ^ 0x5555;
+    return r;
+}
+
+static bool isRecord(const Record &r, size_t seq)
+{
+    return r.seq == seq && r.a == seq * 3 && r.b == ~seq && r.c == (seq ^ 0x5555);
+}
+
+
+static void testBuffer()
+{
+    // capacity rounds up to a power of two
+    LockFreeBuffer<int> small(5);
+    SG_CHECK(small.maxElements() == 8);
+
+    for(int i = 0; i < 8; i++)
+        SG_CHECK(small.put(i) == 1);
+    SG_CHECK(small.put(8) == 0);
+    SG_CHECK(small.atMaximum());
+
+    int out[8];
+    SG_CHECK(small.get(out, 3) == 3);
+    SG_CHECK(out[0] == 0 && out[2] == 2);
+    SG_CHECK(small.numElements() == 5);
+
+    // staged elements are invisible until commit(), and gone after discard()
+    LockFreeBuffer<int> staged(4);
+    SG_CHECK(staged.stage(1) == 1);
+    SG_CHECK(staged.stage(2) == 1);
+    SG_CHECK(staged.numStaged() == 2);
+    int x;
+    SG_CHECK(staged.get(x) == 0);
+    staged.commit();
+    SG_CHECK(staged.get(x) == 1 && x == 1);
+    SG_CHECK(staged.get(x) == 1 && x == 2);
+    staged.stage(3);
+    staged.discard();
+    staged.commit();
+    SG_CHECK(staged.get(x) == 0);
+
+    // staging stops at capacity
+    for(int i = 0; i < 4; i++)
+        staged.stage(i);
+    SG_CHECK(staged.stage(4) == 0);
+}
+
+
+static const size_t NUM_RECORDS = 2000000;
+static LockFreeBuffer<Record> *g_records;
+
+static void *produceRecords(void *)
+{
+    for(size_t i = 0; i < NUM_RECORDS; )
+    {
+        // every so often publish a group at once
+        if(i % 7 == 0 && i + 3 <= NUM_RECORDS)
+        {
+            size_t n = 0;
+            while(n < 3 && g_records->stage(makeRecord(i + n)))
+                n++;
+            if(n < 3)
+            {
+                g_records->discard();
+                sched_yield();
+                continue;
+            }
+            g_records->commit();
+            i += 3;
+        }
+        else if(g_records->put(makeRecord(i)))
+            i++;
+        else
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void testBufferThreads()
+{
+    g_records = new LockFreeBuffer<Record>(256);
+    pthread_t producer;
+    pthread_create(&producer, NULL, produceRecords, NULL);
+
+    Record got[64];
+    size_t expect = 0;
+    bool ok = true;
+    while(expect < NUM_RECORDS && ok)
+    {
+        size_t n = expect % 2 ? g_records->get(got, 64) : g_records->get(got[0]);
+        if(n == 0)
+            sched_yield();
+        for(size_t i = 0; i < n && ok; i++)
+            ok = isRecord(got[i], expect++);
+    }
+    SG_CHECK(ok);
+    SG_CHECK(expect == NUM_RECORDS);
+
+    pthread_join(producer, NULL);
+    delete g_records;
+}
+
+
+// the message naming a run of bytes in the ring
+struct Span
+{
+    size_t start;
+    size_t numBytes;
+    unsigned char seed;
+};
+
+static const size_t NUM_SPANS = 200000;
+static SGPixelRing *g_ring;
+static LockFreeBuffer<Span> *g_spans;
+
+static void *produceSpans(void *)
+{
+    for(size_t i = 0; i < NUM_SPANS; )
+    {
+        Span span;
+        span.numBytes = 1 + (i * 7919) % 3000;
+        span.seed = (unsigned char) i;
+
+        unsigned char *bytes = g_ring->reserve(span.numBytes, span.start);
+        if(bytes == NULL || g_spans->atMaximum())
+        {
+            sched_yield();
+            continue;
+        }
+
+        for(size_t b = 0; b < span.numBytes; b++)
+            bytes[b] = (unsigned char) (span.seed + b);
+        g_ring->commit(span.start, span.numBytes);
+        g_spans->put(span);
+        i++;
+    }
+    return NULL;
+}
+
+static void testRingThreads()
+{
+    g_ring = new SGPixelRing(10000);
+    SG_CHECK(g_ring->size() == 16384);
+    g_spans = new LockFreeBuffer<Span>(64);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, produceSpans, NULL);
+
+    size_t numGot = 0;
+    bool ok = true;
+    while(numGot < NUM_SPANS && ok)
+    {
+        Span span;
+        if(g_spans->get(span) == 0)
+        {
+            sched_yield();
+            continue;
+        }
+
+        const unsigned char *bytes = g_ring->at(span.start);
+        ok = span.seed == (unsigned char) numGot;
+        for(size_t b = 0; b < span.numBytes && ok; b++)
+            ok = bytes[b] == (unsigned char) (span.seed + b);
+        g_ring->release(span.start + span.numBytes);
+        numGot++;
+    }
+    SG_CHECK(ok);
+    SG_CHECK(numGot == NUM_SPANS);
+
+    pthread_join(producer, NULL);
+    delete g_spans;
+    delete g_ring;
+}
+
+
+int main()
+{
+    testBuffer();
+    testBufferThreads();
+    testRingThreads();
+    return sgTestResult("test_lockfreebuffer");
+}
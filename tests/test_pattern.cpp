@@ -0,0 +1,114 @@
+// test_pattern.cpp
+//
+// SGPattern: what each piece of pattern syntax matches, the prefixes a
+// pattern is narrowed down to, and that patterns with many stars, which
+// come from the network, take time proportional to the id rather than
+// growing exponentially.
+
+#include "SGTest.h"
+#include "SGPattern.h"
+
+#include <string>
+#include <sys/time.h>
+
+
+static void testMatch()
+{
+    SG_CHECK(SGPattern::match("abc", "abc"));
+    SG_CHECK(!SGPattern::match("abc", "abd"));
+    SG_CHECK(!SGPattern::match("abc", "abcd"));
+
+    SG_CHECK(SGPattern::match("a*", "a"));
+    SG_CHECK(SGPattern::match("a*", "abc"));
+    SG_CHECK(SGPattern::match("*c", "abc"));
+    SG_CHECK(!SGPattern::match("*c", "abd"));
+    SG_CHECK(SGPattern::match("a*b*c", "axxbyyc"));
+    SG_CHECK(!SGPattern::match("a*b*c", "axxbyy"));
+    SG_CHECK(SGPattern::match("*ab", "aab"));
+    SG_CHECK(SGPattern::match("**", ""));
+
+    SG_CHECK(SGPattern::match("a?c", "abc"));
+    SG_CHECK(!SGPattern::match("a?c", "ac"));
+
+    SG_CHECK(SGPattern::match("[abc]x", "bx"));
+    SG_CHECK(!SGPattern::match("[abc]x", "dx"));
+    SG_CHECK(SGPattern::match("[a-c]x", "bx"));
+    SG_CHECK(!SGPattern::match("[!a-c]x", "bx"));
+    SG_CHECK(SGPattern::match("[!a-c]x", "dx"));
+    SG_CHECK(SGPattern::match("[a-]", "-"));
+    SG_CHECK(!SGPattern::match("a[", "a"));
+
+    SG_CHECK(SGPattern::match("{foo,bar}1", "bar1"));
+    SG_CHECK(!SGPattern::match("{foo,bar}1", "baz1"));
+    SG_CHECK(SGPattern::match("x{,y}", "x"));
+    SG_CHECK(SGPattern::match("x{,y}", "xy"));
+    SG_CHECK(SGPattern::match("{a,ab}c", "abc"));
+    SG_CHECK(!SGPattern::match("a{b", "ab"));
+
+    // a later, shorter alternative can start a match earlier than where an
+    // earlier one ended
+    SG_CHECK(SGPattern::match("*{abcd,bc}*dX", "abcdX"));
+    SG_CHECK(SGPattern::match("*{a,b}*{c,d}*e", "xbyczde"));
+    SG_CHECK(!SGPattern::match("*{a,b}*{c,d}*e", "xbyzze"));
+}
+
+static std::string prefixes(const char *pattern)
+{
+    std::vector<std::string> out;
+    SGPattern::prefixes(pattern, out);
+    std::string joined;
+    for(size_t i = 0; i < out.size(); i++)
+        joined += out[i] + "|";
+    return joined;
+}
+
+static void testPrefixes()
+{
+    SG_CHECK(prefixes("abc") == "abc|");
+    SG_CHECK(prefixes("a*") == "a|");
+    SG_CHECK(prefixes("*") == "|");
+    SG_CHECK(prefixes("{b,a}x*") == "ax|bx|");
+    SG_CHECK(prefixes("{a,ab}*") == "a|");
+    SG_CHECK(prefixes("ab{c,d}{e,f}?") == "abce|abcf|abde|abdf|");
+    SG_CHECK(prefixes("a{b") == "a|");
+}
+
+static double seconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void testStars()
+{
+    // every way of splitting the a's among the stars fails on the b, which
+    // a backtracking matcher would try one by one
+    std::string id(200, 'a');
+    double start = seconds();
+    bool matched = false;
+    for(int k = 0; k < 1000; k++)
+    {
+        matched |= SGPattern::match("*a*a*a*a*a*a*a*a*a*a*b", id.c_str());
+        matched |= SGPattern::match("*{a,aa}*{a,aa}*{a,aa}*{a,aa}*b", id.c_str());
+    }
+    SG_CHECK(!matched);
+    SG_CHECK(seconds() - start < 2);
+
+    SG_CHECK(SGPattern::match("*a*a*a*a*a*a*a*a*a*a*b", (id + "b").c_str()));
+
+    // too many combinations of alternatives to try
+    SG_CHECK(SGPattern::numExpansions("{a,b}{a,b}{a,b}{a,b}") == 16);
+    const char *tooMany = "{a,b}{a,b}{a,b}{a,b}{a,b}{a,b}{a,b}{a,b}{a,b}";
+    SG_CHECK(SGPattern::numExpansions(tooMany) > SGPattern::MAX_EXPANSIONS);
+    SG_CHECK(!SGPattern::match(tooMany, "aaaaaaaaa"));
+}
+
+
+int main()
+{
+    testMatch();
+    testPrefixes();
+    testStars();
+    return sgTestResult("test_pattern");
+}
@@ -0,0 +1,211 @@
+// test_transactions.cpp
+//
+// SGMessageQueue transactions: a producer thread commits bundles that set
+// one value on every one of a group of objects, mixed with lone updates,
+// while the render thread side checks that no frame ever sees part of a
+// bundle, whether the bundles fit in the queue or not. Also checks that a
+// malformed bundle is dropped whole, and that coalescing updates in the
+// overflow list keeps the order of updates that set the same property.
+
+#include "SGTest.h"
+#include "SGMessageQueue.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <vector>
+
+
+static const unsigned NUM_OBJECTS = 100;
+static const int NUM_BUNDLES = 3000;
+
+static SGMessageQueue *g_queue;
+// set by the consumer once it has seen the last bundle
+static size_t g_done;
+
+static SGMessage makeUpdate(unsigned handle, float value)
+{
+    SGMessage msg = SGMessage();
+    msg.type = SGMessage::RED;
+    msg.handle = handle;
+    msg.color.r = value;
+    msg.timeTag = 1;
+    return msg;
+}
+
+static void *produce(void *)
+{
+    for(int v = 1; v <= NUM_BUNDLES; v++)
+    {
+        g_queue->begin();
+        for(unsigned k = 0; k < NUM_OBJECTS; k++)
+            g_queue->put(makeUpdate(k, v));
+        g_queue->commit();
+
+        // a lone update to an object outside the group
+        g_queue->put(makeUpdate(NUM_OBJECTS, v));
+
+        if(v % 16 == 0)
+            usleep(50);
+    }
+
+    // what TimerExpired() would do until everything is through
+    while(!lfb_load_acquire(&g_done))
+    {
+        g_queue->flush();
+        usleep(100);
+    }
+    return NULL;
+}
+
+// run the producer against a queue of capacity messages, checking every
+// frame the consumer makes of what it gets
+static void testQueue(size_t capacity, SGMessageQueue::OverflowPolicy policy)
+{
+    g_queue = new SGMessageQueue(capacity, policy);
+    g_done = 0;
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, NULL);
+
+    std::vector<float> values(NUM_OBJECTS+1, 0);
+    std::vector<SGMessage> msgs;
+    size_t numTorn = 0, numBackwards = 0;
+    float last = 0;
+    while(last < NUM_BUNDLES)
+    {
+        size_t numMsgs = g_queue->getTransactions(msgs);
+        for(size_t m = 0; m < numMsgs; m++)
+            values[msgs[m].handle] = msgs[m].color.r;
+
+        for(unsigned k = 1; k < NUM_OBJECTS; k++)
+        {
+            if(values[k] != values[0])
+            {
+                numTorn++;
+                break;
+            }
+        }
+        if(values[0] < last)
+            numBackwards++;
+        last = values[0];
+
+        if(numMsgs == 0)
+            sched_yield();
+    }
+    lfb_store_release(&g_done, 1);
+    pthread_join(producer, NULL);
+
+    SG_CHECK(numTorn == 0);
+    SG_CHECK(numBackwards == 0);
+    // bundles are never dropped or coalesced, only lone updates may be
+    SG_CHECK(g_queue->numDropped() + g_queue->numCoalesced() <= NUM_BUNDLES);
+    if(numTorn != 0)
+        printf("capacity %lu: %lu torn frames\n", (unsigned long) capacity,
+            (unsigned long) numTorn);
+
+    delete g_queue;
+}
+
+
+// a bundle that fails to parse partway through, after some of its messages
+// and streamed pixels were put, is aborted
+static void testAbort()
+{
+    SGMessageQueue queue(64, SGMessageQueue::GROW);
+    SGPixelRing ring(4096);
+
+    size_t start, first;
+    SG_CHECK(ring.reserve(256, start) != NULL);
+    ring.commit(start, 256);
+
+    queue.begin();
+    queue.put(makeUpdate(0, 1));
+    SGMessage pixels = makeUpdate(0, 0);
+    pixels.type = SGMessage::SUBIMAGE;
+    pixels.size.x = pixels.size.y = 8;
+    SG_CHECK(ring.reserve(256, pixels.pixels) != NULL);
+    ring.commit(pixels.pixels, 256);
+    first = pixels.pixels;
+    queue.put(pixels);
+    queue.put(makeUpdate(1, 1));
+    queue.abort(&ring);
+
+    // nothing of it gets through, and its pixels are free again
+    std::vector<SGMessage> msgs;
+    SG_CHECK(queue.getTransactions(msgs) == 0);
+    SG_CHECK(ring.reserve(256, start) != NULL && start == first);
+
+    // the next bundle is unaffected
+    queue.begin();
+    queue.put(makeUpdate(0, 2));
+    queue.put(makeUpdate(1, 2));
+    queue.commit();
+    SG_CHECK(queue.getTransactions(msgs) == 2);
+    SG_CHECK(msgs[0].color.r == 2 && msgs[1].color.r == 2);
+}
+
+// put msgs to an object behind a full queue, so they wait in the overflow
+// list, and return the red the object ends up with
+static float coalesced(const SGMessage *msgs, size_t numMsgs, size_t &numCoalesced)
+{
+    SGMessageQueue queue(16, SGMessageQueue::COALESCE);
+    for(size_t k = 0; k < queue.capacity(); k++)
+        queue.put(makeUpdate(NUM_OBJECTS + 1 + k, 0));
+    for(size_t m = 0; m < numMsgs; m++)
+        queue.put(msgs[m]);
+
+    float red = 0;
+    SGMessage got[8];
+    size_t numGot;
+    do
+    {
+        numGot = queue.get(got, 8);
+        for(size_t m = 0; m < numGot; m++)
+        {
+            if(got[m].handle == 0 && (got[m].type == SGMessage::RED ||
+                got[m].type == SGMessage::COLOR))
+                red = got[m].color.r;
+        }
+        queue.flush();
+    } while(numGot > 0);
+
+    numCoalesced = queue.numCoalesced();
+    return red;
+}
+
+static void testCoalesceOrder()
+{
+    SGMessage color = makeUpdate(0, 0.5f);
+    color.type = SGMessage::COLOR;
+    SGMessage green = makeUpdate(0, 0);
+    green.type = SGMessage::GREEN;
+    size_t numCoalesced;
+
+    // the second red can't move ahead of the color setting red too
+    SGMessage redColorRed[] = { makeUpdate(0, 1), color, makeUpdate(0, 0.25f) };
+    SG_CHECK(coalesced(redColorRed, 3, numCoalesced) == 0.25f);
+    SG_CHECK(numCoalesced == 0);
+
+    // nor can a color move ahead of a red
+    SGMessage colorRedColor[] = { color, makeUpdate(0, 1), color };
+    SG_CHECK(coalesced(colorRedColor, 3, numCoalesced) == 0.5f);
+    SG_CHECK(numCoalesced == 0);
+
+    // but it can move ahead of green, which sets something else
+    SGMessage redGreenRed[] = { makeUpdate(0, 1), green, makeUpdate(0, 0.25f) };
+    SG_CHECK(coalesced(redGreenRed, 3, numCoalesced) == 0.25f);
+    SG_CHECK(numCoalesced == 1);
+}
+
+
+int main()
+{
+    // bundles smaller and larger than the queue
+    testQueue(1024, SGMessageQueue::GROW);
+    testQueue(64, SGMessageQueue::GROW);
+    testQueue(1024, SGMessageQueue::COALESCE);
+    testQueue(64, SGMessageQueue::DROP_NEWEST);
+    testAbort();
+    testCoalesceOrder();
+    return sgTestResult("test_transactions");
+}